@@ -0,0 +1,570 @@
+//
+//  bench.cpp
+//  msdscript
+//
+//  Benchmark harness for `make bench`. Each workload below is a fixed
+//  msdscript program that is run through one or more engines:
+//
+//    interp        Expr::interp
+//    step          Step::interp_by_steps
+//    parse         parse_str on the program text
+//    print         Expr::to_string on the parsed program
+//    pretty-print  Expr::pp_to_string on the parsed program
+//
+//  The "generated" workload is a large program from ExprGenerator with a
+//  fixed seed; its value is not checked.
+//
+//  Every (workload, engine) pair runs in its own forked worker, so the
+//  memory it reports belongs to that pair alone. A worker checks the
+//  result of one run, then repeats the workload until MIN_TIME has
+//  passed and reports:
+//
+//    ns/run        wall time per run
+//    steps/s       step machine transitions per second; interp rows use
+//                  the step count of the same program so the two engines
+//                  can be compared directly
+//    allocs/run    calls to operator new per run
+//    peak RSS      high-water resident set size of the worker after the
+//                  first run; later runs are left out because nothing is
+//                  freed while pointer.h uses plain pointers
+//
+//  With --repeat N every pair is measured by N workers. The reported
+//  time is the median after dropping outliers, next to the median
+//  absolute deviation as a percentage of it.
+//
+//  --json FILE writes the results, with a fingerprint of the machine and
+//  build, and --baseline FILE compares them to an earlier --json file.
+//  The exit status is non-zero if any pair got slower by more than
+//  --threshold percent (default 10) or allocates more than before.
+//  `make bench-check` runs that comparison against bench/baseline.json
+//  with BENCH_THRESHOLD from the Makefile (override with
+//  `make bench-check BENCH_THRESHOLD=5`),
+//  and `make bench-baseline` rewrites the baseline.
+//
+//  Usage: bench_msdscript [--repeat N] [--json FILE] [--baseline FILE]
+//                         [--threshold PERCENT] [workload...]
+//
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <stdexcept>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+#include "../msdscript/cmdline.h"
+#include "../test_msdscript/test_msdscript/random_expr.hpp"
+
+static const double MIN_TIME = 0.3;
+static const long MIN_RUNS = 3;
+static const long MAX_RUNS = 100000;
+
+// Every operator new in the process goes through here so workers can
+// count allocations
+static long allocations = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+// Variable names are letters only, so number them in base 26
+static std::string var_name(int i) {
+    std::string name = "x";
+    do {
+        name += (char)('a' + i % 26);
+        i /= 26;
+    } while (i > 0);
+    return name;
+}
+
+static std::string let_chain(int n) {
+    std::ostringstream s;
+    s << "_let " << var_name(0) << " = 1 _in ";
+    for (int i = 1; i < n; i++)
+        s << "_let " << var_name(i) << " = " << var_name(i - 1) << " + 1 _in ";
+    s << var_name(n - 1);
+    return s.str();
+}
+
+static std::string wide_sum(int n) {
+    std::ostringstream s;
+    s << "1";
+    for (int i = 2; i <= n; i++)
+        s << " + " << i;
+    return s.str();
+}
+
+struct Workload {
+    std::string name;
+    std::string program;
+    std::string expected;
+    std::vector<std::string> engines;
+};
+
+static std::vector<Workload> workloads() {
+    std::vector<std::string> eval = {"step", "interp"};
+    std::vector<Workload> w;
+    w.push_back({"factorial",
+        "_let fact = _fun (f) _fun (n) _if n == 0 _then 1 _else n * f(f)(n + -1) "
+        "_in fact(fact)(12)",
+        "479001600", eval});
+    w.push_back({"fibonacci",
+        "_let fib = _fun (f) _fun (n) _if n == 0 _then 0 _else _if n == 1 _then 1 "
+        "_else f(f)(n + -1) + f(f)(n + -2) "
+        "_in fib(fib)(18)",
+        "2584", eval});
+    w.push_back({"fact-letrec",
+        "_letrec fact = _fun (n) _if n == 0 _then 1 _else n * fact(n + -1) _in fact(12)",
+        "479001600", eval});
+    w.push_back({"fib-letrec",
+        "_letrec fib = _fun (n) _if n == 0 _then 0 _else _if n == 1 _then 1 "
+        "_else fib(n + -1) + fib(n + -2) "
+        "_in fib(18)",
+        "2584", eval});
+    w.push_back({"fact-big",
+        "_letrec fact = _fun (n) _if n == 0 _then 1 _else n * fact(n + -1) _in fact(60)",
+        "8320987112741390144276341183223364380754172606361245952449277696409600000000000000",
+        eval});
+    w.push_back({"let-chain", let_chain(1000), "1000", eval});
+    w.push_back({"wide-sum", wide_sum(2000), "2001000", eval});
+    w.push_back({"currying",
+        "_let addthree = _fun (a) _fun (b) _fun (c) a + b + c "
+        "_in _let loop = _fun (loop) _fun (n) _if n == 0 _then 0 "
+        "_else addthree(n)(1)(2) + loop(loop)(n + -1) "
+        "_in loop(loop)(1000)",
+        "503500", eval});
+    GenOptions shape;
+    shape.depth = 14;
+    shape.width = 4;
+    std::string generated = ExprGenerator(31, shape).program();
+    w.push_back({"generated", generated, "", {"step", "interp", "parse", "print"}});
+    w.push_back({"parse", let_chain(2000), "", {"parse"}});
+    w.push_back({"print", let_chain(2000), "", {"print", "pretty-print"}});
+    return w;
+}
+
+// What a worker sends back to the parent over its pipe
+struct Result {
+    bool ok;
+    long runs;
+    long steps;
+    double ns_per_run;
+    double allocs_per_run;
+    long peak_kb;
+    char error[256];
+};
+
+// Run `engine` on `w` once; returns the printed value for evaluating
+// engines and an empty string otherwise
+static std::string run_once(const Workload &w, const std::string &engine, PTR(Expr) e) {
+    if (engine == "interp")
+        return e->interp(Env::empty)->to_string();
+    if (engine == "step")
+        return Step::interp_by_steps(e)->to_string();
+    if (engine == "parse")
+        parse_str(w.program);
+    else if (engine == "print")
+        e->to_string();
+    else if (engine == "pretty-print")
+        e->pp_to_string();
+    else
+        throw std::runtime_error("unknown engine " + engine);
+    return "";
+}
+
+static Result measure(const Workload &w, const std::string &engine) {
+    Result r;
+    memset(&r, 0, sizeof(r));
+    try {
+        PTR(Expr) e = parse_str(w.program);
+        std::string got = run_once(w, engine, e);
+        if (!w.expected.empty() && got != w.expected)
+            throw std::runtime_error("expected " + w.expected + ", got " + got);
+        if (engine == "step")
+            r.steps = Step::steps;
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        r.peak_kb = usage.ru_maxrss / 1024;
+#else
+        r.peak_kb = usage.ru_maxrss;
+#endif
+
+        typedef std::chrono::steady_clock clock;
+        long start_allocs = allocations;
+        clock::time_point start = clock::now();
+        double elapsed = 0;
+        while ((r.runs < MIN_RUNS || elapsed < MIN_TIME) && r.runs < MAX_RUNS) {
+            run_once(w, engine, e);
+            r.runs++;
+            elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        }
+        r.ns_per_run = elapsed * 1e9 / r.runs;
+        r.allocs_per_run = (double)(allocations - start_allocs) / r.runs;
+        r.ok = true;
+    } catch (std::exception &err) {
+        strncpy(r.error, err.what(), sizeof(r.error) - 1);
+    }
+    return r;
+}
+
+// Run measure in a forked worker and read its Result back over a pipe
+static Result measure_in_worker(const Workload &w, const std::string &engine) {
+    int fds[2];
+    if (pipe(fds) == -1)
+        throw std::runtime_error("pipe failed");
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == -1)
+        throw std::runtime_error("fork failed");
+    if (pid == 0) {
+        close(fds[0]);
+        Result r = measure(w, engine);
+        ssize_t n = write(fds[1], &r, sizeof(r));
+        _exit(n == (ssize_t)sizeof(r) ? 0 : 1);
+    }
+    close(fds[1]);
+
+    Result r;
+    memset(&r, 0, sizeof(r));
+    size_t got = 0;
+    while (got < sizeof(r)) {
+        ssize_t n = read(fds[0], (char *)&r + got, sizeof(r) - got);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    close(fds[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) == -1)
+        throw std::runtime_error("wait failed");
+    if (got < sizeof(r)) {
+        r.ok = false;
+        snprintf(r.error, sizeof(r.error), "worker died (status %d)", status);
+    }
+    return r;
+}
+
+// Median of `v`, which must not be empty
+static double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// Summary of repeated measurements of one (workload, engine) pair
+struct Summary {
+    std::string workload;
+    std::string engine;
+    double ns_per_run;      // median of the samples that were kept
+    double mad;             // median absolute deviation of all samples
+    long samples;
+    long kept;
+    long steps;
+    double allocs_per_run;
+    long peak_kb;
+};
+
+// Samples further than OUTLIER_MADS scaled MADs from the median are
+// dropped before taking the median again; 1.4826 scales a MAD to a
+// standard deviation for normally distributed noise
+static const double OUTLIER_MADS = 3.0;
+
+static Summary summarize(const std::string &workload, const std::string &engine,
+                         const std::vector<Result> &results) {
+    Summary s;
+    s.workload = workload;
+    s.engine = engine;
+    std::vector<double> ns, deviations;
+    for (const Result &r : results)
+        ns.push_back(r.ns_per_run);
+    double mid = median(ns);
+    for (double x : ns)
+        deviations.push_back(fabs(x - mid));
+    s.mad = median(deviations);
+
+    std::vector<double> kept;
+    for (double x : ns) {
+        if (s.mad == 0 || fabs(x - mid) <= OUTLIER_MADS * 1.4826 * s.mad)
+            kept.push_back(x);
+    }
+    s.ns_per_run = median(kept);
+    s.samples = (long)ns.size();
+    s.kept = (long)kept.size();
+    s.steps = results[0].steps;
+    s.allocs_per_run = results[0].allocs_per_run;
+    s.peak_kb = 0;
+    for (const Result &r : results)
+        s.peak_kb = std::max(s.peak_kb, r.peak_kb);
+    return s;
+}
+
+static std::string json_escape(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c >= ' ')
+            out += c;
+    }
+    return out;
+}
+
+// Results are only comparable on the same machine and build, so they
+// carry a description of both
+static std::string machine_fingerprint() {
+    struct utsname u;
+    uname(&u);
+    std::string cpu = "unknown";
+#ifdef __APPLE__
+    char brand[256];
+    size_t len = sizeof(brand);
+    if (sysctlbyname("machdep.cpu.brand_string", brand, &len, NULL, 0) == 0)
+        cpu = brand;
+#else
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos)
+                cpu = line.substr(line.find_first_not_of(" \t", colon + 1));
+            break;
+        }
+    }
+#endif
+    std::ostringstream s;
+    s << "{\"os\": \"" << json_escape(u.sysname) << " " << json_escape(u.release) << "\""
+      << ", \"arch\": \"" << json_escape(u.machine) << "\""
+      << ", \"cpu\": \"" << json_escape(cpu) << "\""
+      << ", \"cores\": " << sysconf(_SC_NPROCESSORS_ONLN)
+      << ", \"compiler\": \"" << json_escape(__VERSION__) << "\""
+      << ", \"pointers\": \"" << (USE_PLAIN_POINTERS ? "plain" : "shared") << "\"}";
+    return s.str();
+}
+
+// Results are written one object per line so that read_json can find
+// them without a full JSON parser
+static void write_json(const std::string &path, const std::vector<Summary> &summaries) {
+    std::ofstream out(path);
+    if (!out)
+        throw std::runtime_error("cannot write " + path);
+    out << "{\n  \"machine\": " << machine_fingerprint() << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < summaries.size(); i++) {
+        const Summary &s = summaries[i];
+        out << std::fixed << std::setprecision(1)
+            << "    {\"workload\": \"" << json_escape(s.workload) << "\""
+            << ", \"engine\": \"" << json_escape(s.engine) << "\""
+            << ", \"ns_per_run\": " << s.ns_per_run
+            << ", \"mad\": " << s.mad
+            << ", \"samples\": " << s.samples
+            << ", \"kept\": " << s.kept
+            << ", \"steps\": " << s.steps
+            << ", \"allocs_per_run\": " << s.allocs_per_run
+            << ", \"peak_kb\": " << s.peak_kb << "}"
+            << (i + 1 < summaries.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static std::string json_field(const std::string &line, const std::string &key) {
+    std::string tag = "\"" + key + "\": ";
+    size_t at = line.find(tag);
+    if (at == std::string::npos)
+        return "";
+    at += tag.size();
+    if (line[at] != '"')
+        return line.substr(at, line.find_first_of(",}", at) - at);
+    std::string value;
+    for (size_t i = at + 1; i < line.size() && line[i] != '"'; i++) {
+        if (line[i] == '\\')
+            i++;
+        value += line[i];
+    }
+    return value;
+}
+
+// Read back a file written by write_json; `machine` gets its fingerprint
+static std::vector<Summary> read_json(const std::string &path, std::string *machine) {
+    std::ifstream in(path);
+    if (!in)
+        throw std::runtime_error("cannot read " + path);
+    std::vector<Summary> summaries;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.find("\"machine\": ") != std::string::npos) {
+            *machine = line.substr(line.find('{'));
+        } else if (line.find("\"workload\": ") != std::string::npos) {
+            Summary s;
+            s.workload = json_field(line, "workload");
+            s.engine = json_field(line, "engine");
+            s.ns_per_run = atof(json_field(line, "ns_per_run").c_str());
+            s.mad = atof(json_field(line, "mad").c_str());
+            s.samples = atol(json_field(line, "samples").c_str());
+            s.kept = atol(json_field(line, "kept").c_str());
+            s.steps = atol(json_field(line, "steps").c_str());
+            s.allocs_per_run = atof(json_field(line, "allocs_per_run").c_str());
+            s.peak_kb = atol(json_field(line, "peak_kb").c_str());
+            summaries.push_back(s);
+        }
+    }
+    return summaries;
+}
+
+// Compare against a baseline; returns the number of regressions. Time
+// regresses when the median grows by more than `threshold` percent.
+// Allocation counts do not depend on the machine, so any growth in them
+// is a regression too.
+static int compare(const std::vector<Summary> &now, const std::string &baseline_path,
+                   double threshold) {
+    std::string base_machine;
+    std::vector<Summary> base = read_json(baseline_path, &base_machine);
+    std::string machine = machine_fingerprint();
+    if (base_machine.substr(0, base_machine.rfind('}') + 1) != machine)
+        std::cout << "\nwarning: baseline was recorded on a different machine or build:\n"
+                  << "  baseline " << base_machine << "\n  this run " << machine << "\n";
+
+    std::cout << "\n" << std::left << std::setw(12) << "workload" << std::setw(14) << "engine"
+              << std::right << std::setw(14) << "baseline ns" << std::setw(14) << "ns/run"
+              << std::setw(10) << "change" << "  status\n";
+    int regressions = 0;
+    for (const Summary &s : now) {
+        const Summary *b = NULL;
+        for (const Summary &candidate : base) {
+            if (candidate.workload == s.workload && candidate.engine == s.engine)
+                b = &candidate;
+        }
+        std::cout << std::left << std::setw(12) << s.workload << std::setw(14) << s.engine;
+        if (b == NULL) {
+            std::cout << "  not in baseline\n";
+            continue;
+        }
+        double change = (s.ns_per_run - b->ns_per_run) * 100 / b->ns_per_run;
+        std::string status = "ok";
+        if (change > threshold)
+            status = "SLOWER";
+        if (s.allocs_per_run > b->allocs_per_run + 0.5)
+            status = (status == "ok") ? "MORE ALLOCS" : status + ", MORE ALLOCS";
+        if (status != "ok")
+            regressions++;
+        std::cout << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << b->ns_per_run << std::setw(14) << s.ns_per_run
+                  << std::setw(9) << std::setprecision(1) << std::showpos << change
+                  << std::noshowpos << "%  " << status << "\n";
+    }
+    std::cout << "\n" << regressions << " regression" << (regressions == 1 ? "" : "s")
+              << " (threshold " << threshold << "%)\n";
+    return regressions;
+}
+
+static void usage() {
+    std::cerr << "usage: bench_msdscript [--repeat N] [--json FILE] [--baseline FILE]"
+              << " [--threshold PERCENT] [workload...]\n";
+    exit(2);
+}
+
+int main(int argc, const char * argv[]) {
+    int repeat = 1;
+    double threshold = 10;
+    std::string json_path, baseline_path;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--repeat" && has_value)
+            repeat = atoi(argv[++i]);
+        else if (arg == "--json" && has_value)
+            json_path = argv[++i];
+        else if (arg == "--baseline" && has_value)
+            baseline_path = argv[++i];
+        else if (arg == "--threshold" && has_value)
+            threshold = atof(argv[++i]);
+        else if (arg.compare(0, 2, "--") == 0)
+            usage();
+        else
+            names.push_back(arg);
+    }
+    if (repeat < 1)
+        usage();
+
+    std::cout << std::left << std::setw(12) << "workload" << std::setw(14) << "engine"
+              << std::right << std::setw(8) << "runs" << std::setw(14) << "ns/run"
+              << std::setw(10) << "mad %" << std::setw(14) << "steps/s"
+              << std::setw(12) << "allocs/run" << std::setw(14) << "peak RSS KB" << "\n";
+
+    int failed = 0;
+    std::vector<Summary> summaries;
+    for (const Workload &w : workloads()) {
+        if (!names.empty() && std::find(names.begin(), names.end(), w.name) == names.end())
+            continue;
+        long steps = 0;
+        for (const std::string &engine : w.engines) {
+            std::vector<Result> results;
+            long runs = 0;
+            for (int i = 0; i < repeat; i++) {
+                Result r = measure_in_worker(w, engine);
+                if (!r.ok) {
+                    results.clear();
+                    results.push_back(r);
+                    break;
+                }
+                results.push_back(r);
+                runs += r.runs;
+            }
+            std::cout << std::left << std::setw(12) << w.name << std::setw(14) << engine;
+            if (!results[0].ok) {
+                std::cout << "FAILED: " << results[0].error << "\n";
+                failed++;
+                continue;
+            }
+            Summary s = summarize(w.name, engine, results);
+            summaries.push_back(s);
+            if (engine == "step")
+                steps = s.steps;
+            std::ostringstream rate;
+            if (steps > 0 && (engine == "step" || engine == "interp"))
+                rate << std::fixed << std::setprecision(0) << steps * 1e9 / s.ns_per_run;
+            else
+                rate << "-";
+            std::cout << std::right << std::fixed << std::setprecision(0)
+                      << std::setw(8) << runs << std::setw(14) << s.ns_per_run
+                      << std::setw(10) << std::setprecision(1) << s.mad * 100 / s.ns_per_run
+                      << std::setprecision(0) << std::setw(14) << rate.str()
+                      << std::setw(12) << s.allocs_per_run
+                      << std::setw(14) << s.peak_kb << "\n";
+        }
+    }
+
+    if (!json_path.empty())
+        write_json(json_path, summaries);
+    if (!baseline_path.empty() && compare(summaries, baseline_path, threshold) > 0)
+        failed++;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+//
+//  Cancel.cpp
+//  msdscript
+//
+
+#include "Cancel.h"
+#include "Expr.h"
+#include "Val.h"
+#include "Env.h"
+#include "Step.h"
+#include "Parse.h"
+#include "Program.h"
+#include "Native.h"
+#include "catch.h"
+#include <thread>
+#include <chrono>
+
+thread_local CancelToken *CancelScope::current = NULL;
+
+CancelToken::CancelToken() : flag(false) {
+}
+
+void CancelToken::cancel(){
+    flag.store(true, std::memory_order_relaxed);
+}
+
+EvalCancelled::EvalCancelled() : std::runtime_error("evaluation cancelled") {
+}
+
+CancelScope::CancelScope(CancelToken *token){
+    this->outer = current;
+    if(token != NULL)
+        current = token;
+}
+
+CancelScope::~CancelScope(){
+    current = outer;
+}
+
+//how long run takes to throw EvalCancelled once another thread cancels
+//after a short delay, in milliseconds, or -1 if it returned instead
+template <typename F>
+static long ms_to_cancel(F run){
+    CancelToken token;
+    //before the thread starts, so the delay can't begin ahead of the clock
+    auto start = std::chrono::steady_clock::now();
+    std::thread canceller([&token]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        token.cancel();
+    });
+    long ms = -1;
+    try {
+        CancelScope scope(&token);
+        run();
+    } catch(EvalCancelled &){
+        ms = (long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    canceller.join();
+    return ms;
+}
+
+TEST_CASE("Cancel"){
+    PTR(Expr) forever = parse_str("_letrec loop = _fun (n) loop(n + 1) _in loop(0)");
+    PTR(Expr) fib = parse_str("_letrec fib = _fun (n) _if n == 0 _then 0 _else _if n == 1 _then 1 "
+                              "_else fib(n + -1) + fib(n + -2) _in fib(40)");
+    
+    //a program that never ends stops soon after the cancel
+    long ms = ms_to_cancel([&]{ Step::interp_by_steps(forever); });
+    CHECK(ms >= 20);
+    CHECK(ms < 1000);
+    ms = ms_to_cancel([&]{ fib->interp(Env::empty); });
+    CHECK(ms >= 20);
+    CHECK(ms < 1000);
+    //and so does a native working on ever larger numbers
+    PTR(Expr) huge = parse_str("pow(3)(2000000000)");
+    ms = ms_to_cancel([&]{ huge->interp(Natives::env()); });
+    CHECK(ms >= 20);
+    CHECK(ms < 1000);
+    
+    CancelToken cancelled;
+    cancelled.cancel();
+    CHECK_THROWS_WITH(Step::interp_by_steps(forever, Env::empty, &cancelled), "evaluation cancelled");
+    {
+        CancelScope scope(&cancelled);
+        CHECK_THROWS_AS(parse_str("(_fun (x) x)(1)")->interp(Env::empty), EvalCancelled);
+        //nothing is checked outside calls, so these still finish
+        CHECK(parse_str("_let x = 1 _in x + 2")->interp(Env::empty)->to_string() == "3");
+        {
+            CancelToken live;
+            CancelScope inner(&live);
+            CHECK(parse_str("(_fun (x) x)(1)")->interp(Env::empty)->to_string() == "1");
+            CancelScope same(NULL);
+            CHECK(CancelScope::current == &live);
+        }
+        CHECK_THROWS_AS(parse_str("(_fun (x) x)(1)")->interp(Env::empty), EvalCancelled);
+    }
+    CHECK(CancelScope::current == NULL);
+    CHECK(parse_str("(_fun (x) x)(1)")->interp(Env::empty)->to_string() == "1");
+    
+    Program twice("f(f(x))");
+    std::map<std::string, PTR(Val)> bindings = {{"f", parse_str("_fun (n) n * 2")->interp(Env::empty)}, {"x", NEW(NumVal)(5)}};
+    CancelToken live;
+    CHECK(twice.run(bindings, &live)->to_string() == "20");
+    CHECK(twice.run_by_steps(bindings, &live)->to_string() == "20");
+    CHECK_THROWS_AS(twice.run(bindings, &cancelled), EvalCancelled);
+    CHECK_THROWS_AS(twice.run_by_steps(bindings, &cancelled), EvalCancelled);
+}
@@ -0,0 +1,59 @@
+//
+//  Cancel.h
+//  msdscript
+//
+
+#ifndef Cancel_h
+#define Cancel_h
+
+#include <stdio.h>
+#include <atomic>
+#include <stdexcept>
+
+//lets a host stop an evaluation from another thread: the evaluating thread
+//opens a CancelScope on the token, and any thread may call cancel. Both
+//engines look at the token on every function call, and the step machine on
+//every continuation too, since a program can only loop by calling
+class CancelToken {
+public:
+    CancelToken();
+    
+    void cancel();
+    bool cancelled(){
+        return flag.load(std::memory_order_relaxed);
+    }
+    
+private:
+    std::atomic<bool> flag;
+};
+
+//what a cancelled evaluation throws; a runtime_error like every other
+//evaluation error, but a host can catch it apart from them
+class EvalCancelled : public std::runtime_error {
+public:
+    EvalCancelled();
+};
+
+//makes token the one checked on this thread until the scope ends, after
+//which the one from any enclosing scope is checked again. A NULL token
+//leaves the enclosing one in place, so entry points that take an optional
+//token can always open a scope
+class CancelScope {
+public:
+    static thread_local CancelToken *current;
+    
+    CancelScope(CancelToken *token);
+    ~CancelScope();
+    
+    //throws EvalCancelled if the current token has been cancelled
+    static void check(){
+        CancelToken *token = current;
+        if(token != NULL && token->cancelled())
+            throw EvalCancelled();
+    }
+    
+private:
+    CancelToken *outer;
+};
+
+#endif /* Cancel_h */
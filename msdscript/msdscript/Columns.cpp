@@ -0,0 +1,306 @@
+//
+//  Columns.cpp
+//  msdscript
+//
+
+#include "Columns.h"
+#include "Expr.h"
+#include "Val.h"
+#include "Program.h"
+#include "Parse.h"
+#include "catch.h"
+#include <string.h>
+#include <stdexcept>
+
+ColumnPlan::ColumnPlan(){
+    this->result = -1;
+}
+
+int ColumnPlan::add_reg(reg_kind_t kind, bool is_bool, int val){
+    Reg reg = { kind, is_bool, val };
+    regs.push_back(reg);
+    return (int)regs.size() - 1;
+}
+
+int ColumnPlan::add_op(op_kind_t kind, bool is_bool, int a, int b, int c){
+    int dst = add_reg(reg_op, is_bool, 0);
+    Op op = { kind, dst, a, b, c };
+    ops.push_back(op);
+    return dst;
+}
+
+//arithmetic wraps through unsigned, without the undefined behavior of
+//int overflow; the ops check for it afterwards
+static int wrap_add(int a, int b){
+    return (int)((unsigned)a + (unsigned)b);
+}
+
+static int wrap_mult(int a, int b){
+    return (int)((unsigned)a * (unsigned)b);
+}
+
+static bool fits_int(int64_t v){
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+//the register holding e's value, or -1 if e can't be compiled. Operations
+//on constants are done here instead of once per row
+int ColumnPlan::compile_expr(PTR(Expr) e, std::vector<std::pair<std::string, int>> &scope){
+    switch(e->kind){
+        case expr_kind_num: {
+            PTR(NumExpr) num = KIND_CAST(NumExpr)(e);
+            if(num->numVal->kind != val_kind_num || !fits_int(num->val))
+                return -1;
+            return add_reg(reg_const, false, (int)num->val);
+        }
+        case expr_kind_bool:
+            return add_reg(reg_const, true, KIND_CAST(BoolExpr)(e)->boolVal);
+        case expr_kind_var: {
+            std::string name = KIND_CAST(VarExpr)(e)->var;
+            for(size_t i = scope.size(); i-- > 0;)
+                if(scope[i].first == name)
+                    return scope[i].second;
+            for(size_t i = 0; i < inputs.size(); i++)
+                if(inputs[i] == name){
+                    if(input_regs[i] < 0)
+                        input_regs[i] = add_reg(reg_input, false, (int)i);
+                    return input_regs[i];
+                }
+            return -1;
+        }
+        case expr_kind_add:
+        case expr_kind_mult: {
+            bool add = e->kind == expr_kind_add;
+            int lhs = add ? compile_expr(KIND_CAST(AddExpr)(e)->lhs, scope) : compile_expr(KIND_CAST(MultExpr)(e)->lhs, scope);
+            if(lhs < 0 || regs[lhs].is_bool)
+                return -1;
+            int rhs = add ? compile_expr(KIND_CAST(AddExpr)(e)->rhs, scope) : compile_expr(KIND_CAST(MultExpr)(e)->rhs, scope);
+            if(rhs < 0 || regs[rhs].is_bool)
+                return -1;
+            if(regs[lhs].kind == reg_const && regs[rhs].kind == reg_const){
+                int64_t folded = add ? (int64_t)regs[lhs].val + regs[rhs].val : (int64_t)regs[lhs].val * regs[rhs].val;
+                return fits_int(folded) ? add_reg(reg_const, false, (int)folded) : -1;
+            }
+            return add_op(add ? op_add : op_mult, false, lhs, rhs);
+        }
+        case expr_kind_eq: {
+            int lhs = compile_expr(KIND_CAST(EqExpr)(e)->lhs, scope);
+            int rhs = lhs < 0 ? -1 : compile_expr(KIND_CAST(EqExpr)(e)->rhs, scope);
+            if(rhs < 0)
+                return -1;
+            //a number never equals a boolean
+            if(regs[lhs].is_bool != regs[rhs].is_bool)
+                return add_reg(reg_const, true, 0);
+            if(regs[lhs].kind == reg_const && regs[rhs].kind == reg_const)
+                return add_reg(reg_const, true, regs[lhs].val == regs[rhs].val);
+            return add_op(op_eq, true, lhs, rhs);
+        }
+        case expr_kind_if: {
+            PTR(IfExpr) i = KIND_CAST(IfExpr)(e);
+            int test = compile_expr(i->test_part, scope);
+            if(test < 0 || !regs[test].is_bool)
+                return -1;
+            //like the other engines, only the branch taken has to work
+            if(regs[test].kind == reg_const)
+                return compile_expr(regs[test].val ? i->then_part : i->else_part, scope);
+            int then_reg = compile_expr(i->then_part, scope);
+            int else_reg = then_reg < 0 ? -1 : compile_expr(i->else_part, scope);
+            if(else_reg < 0 || regs[then_reg].is_bool != regs[else_reg].is_bool)
+                return -1;
+            return add_op(op_select, regs[then_reg].is_bool, test, then_reg, else_reg);
+        }
+        case expr_kind_let: {
+            PTR(LetExpr) let = KIND_CAST(LetExpr)(e);
+            int rhs = compile_expr(let->rhs, scope);
+            if(rhs < 0)
+                return -1;
+            scope.push_back(std::make_pair(let->lhs, rhs));
+            int body = compile_expr(let->body, scope);
+            scope.pop_back();
+            return body;
+        }
+        default:
+            return -1;
+    }
+}
+
+bool ColumnPlan::compile(PTR(Expr) e, const std::vector<std::string> &inputs){
+    this->ops.clear();
+    this->regs.clear();
+    this->inputs = inputs;
+    this->input_regs.assign(inputs.size(), -1);
+    std::vector<std::pair<std::string, int>> scope;
+    this->result = compile_expr(e, scope);
+    return result >= 0;
+}
+
+bool ColumnPlan::result_is_bool(){
+    return regs[result].is_bool;
+}
+
+//one op over a whole block. Every loop runs exactly BLOCK times over
+//pointers that can't overlap the destination, which is what it takes
+//for the compiler to vectorize at -O2. + and * return whether any row
+//overflowed, found without branches: a sum overflowed when its sign
+//differs from both operands' signs
+static bool add_block(int *__restrict d, const int *__restrict a, const int *__restrict b){
+    int over = 0;
+    for(int i = 0; i < ColumnPlan::BLOCK; i++){
+        d[i] = wrap_add(a[i], b[i]);
+        over |= (a[i] ^ d[i]) & (b[i] ^ d[i]);
+    }
+    return over < 0;
+}
+
+//products of operands in 16 bits can't overflow, which takes only 32 bit
+//ops to see; SSE2 has no signed multiply to 64 bits to check every
+//product with, so larger operands get a second, scalar pass
+static bool mult_block(int *__restrict d, const int *__restrict a, const int *__restrict b){
+    unsigned large = 0;
+    for(int i = 0; i < ColumnPlan::BLOCK; i++){
+        d[i] = wrap_mult(a[i], b[i]);
+        large |= ((unsigned)a[i] + 0x8000) | ((unsigned)b[i] + 0x8000);
+    }
+    if(large < 0x10000)
+        return false;
+    for(int i = 0; i < ColumnPlan::BLOCK; i++)
+        if((int64_t)a[i] * b[i] != d[i])
+            return true;
+    return false;
+}
+
+static void eq_block(int *__restrict d, const int *__restrict a, const int *__restrict b){
+    for(int i = 0; i < ColumnPlan::BLOCK; i++)
+        d[i] = a[i] == b[i];
+}
+
+//test is 1 or 0, so -test masks in one branch or the other
+static void select_block(int *__restrict d, const int *__restrict test, const int *__restrict a, const int *__restrict b){
+    for(int i = 0; i < ColumnPlan::BLOCK; i++)
+        d[i] = (a[i] & -test[i]) | (b[i] & (test[i] - 1));
+}
+
+void ColumnPlan::run(const std::vector<const int *> &columns, size_t rows, int *out, std::vector<size_t> *overflowed){
+    if(result < 0)
+        throw std::runtime_error("column plan is not compiled");
+    std::vector<int> block(regs.size() * BLOCK);
+    //where each register's values are for the current block. Constants
+    //are filled in once; inputs are read in place, except in a last,
+    //partial block, where they are copied into their registers so the
+    //ops can still run over all BLOCK rows
+    std::vector<const int *> at(regs.size());
+    for(size_t r = 0; r < regs.size(); r++){
+        at[r] = &block[r * BLOCK];
+        if(regs[r].kind == reg_const)
+            for(int i = 0; i < BLOCK; i++)
+                block[r * BLOCK + i] = regs[r].val;
+    }
+    
+    for(size_t start = 0; start < rows; start += BLOCK){
+        bool full = rows - start >= (size_t)BLOCK;
+        int n = full ? BLOCK : (int)(rows - start);
+        for(size_t r = 0; r < regs.size(); r++)
+            if(regs[r].kind == reg_input){
+                if(full)
+                    at[r] = columns[regs[r].val] + start;
+                else {
+                    memcpy(&block[r * BLOCK], columns[regs[r].val] + start, n * sizeof(int));
+                    at[r] = &block[r * BLOCK];
+                }
+            }
+        //the last op writes straight to out
+        if(regs[result].kind == reg_op)
+            at[result] = full ? out + start : &block[result * BLOCK];
+        bool over = false;
+        for(const Op &op : ops){
+            int *d = (int *)at[op.dst];
+            switch(op.kind){
+                case op_add:
+                    over |= add_block(d, at[op.a], at[op.b]);
+                    break;
+                case op_mult:
+                    over |= mult_block(d, at[op.a], at[op.b]);
+                    break;
+                case op_eq:
+                    eq_block(d, at[op.a], at[op.b]);
+                    break;
+                case op_select:
+                    select_block(d, at[op.a], at[op.b], at[op.c]);
+                    break;
+            }
+        }
+        if(over)
+            overflowed->push_back(start);
+        else if(at[result] != out + start)
+            memcpy(out + start, at[result], n * sizeof(int));
+    }
+}
+
+//checks run_columns against run, row by row
+static bool same_as_rows(Program &p, const std::map<std::string, std::vector<int>> &columns){
+    std::vector<int> got = p.run_columns(columns);
+    size_t rows = columns.empty() ? 0 : columns.begin()->second.size();
+    if(got.size() != rows)
+        return false;
+    for(size_t row = 0; row < rows; row++){
+        std::map<std::string, PTR(Val)> bindings;
+        for(auto &column : columns)
+            bindings[column.first] = NEW(NumVal)(column.second[row]);
+        PTR(Val) v = p.run(bindings);
+        PTR(BoolVal) b = KIND_CAST(BoolVal)(v);
+        int expected = b != NULL ? b->boolVal : KIND_CAST(NumVal)(v)->val;
+        if(got[row] != expected)
+            return false;
+    }
+    return true;
+}
+
+TEST_CASE("Columns"){
+    std::vector<int> x, y;
+    //crosses a block boundary
+    for(int i = 0; i < ColumnPlan::BLOCK * 2 + 37; i++){
+        x.push_back(i * 7919 % 601 - 300);
+        y.push_back(i % 5);
+    }
+    std::map<std::string, std::vector<int>> columns = {{"x", x}, {"y", y}};
+    
+    ColumnPlan plan;
+    CHECK(plan.compile(parse_str("_let d = x + -1 _in _if y == 2 _then d * d _else (_if x == d _then 1 _else y)"), {"x", "y"}));
+    CHECK(!plan.compile(parse_str("max(x)(y)"), {"x", "y"}));
+    CHECK(!plan.compile(parse_str("x + z"), {"x", "y"}));
+    CHECK(!plan.compile(parse_str("_if y == 1 _then x _else _true"), {"x", "y"}));
+    CHECK(!plan.compile(parse_str("_if x _then 1 _else 2"), {"x", "y"}));
+    //only the branch taken by a constant test needs to compile
+    CHECK(plan.compile(parse_str("_if 1 == 2 _then x + _true _else x"), {"x"}));
+    
+    Program formula("_let d = x + -1 _in _if y == 2 _then d * d _else (_if x == d + 1 _then (2 + 3) * x _else y)");
+    CHECK(same_as_rows(formula, columns));
+    Program test("(x * y == 0) == (x == 0 == _false)");
+    CHECK(same_as_rows(test, columns));
+    Program constant("_let k = 6 * 7 _in _if k == 42 _then k _else x");
+    CHECK(same_as_rows(constant, {{"x", x}}));
+    Program input("y");
+    CHECK(same_as_rows(input, {{"y", y}}));
+    Program mixed("x == _true");
+    CHECK(same_as_rows(mixed, {{"x", x}}));
+    
+    //anything else still runs, row by row
+    Program natives("max(x)(y) + (_fun (a) a * 2)(y)");
+    CHECK(same_as_rows(natives, columns));
+    CHECK_THROWS_WITH(Program("_if y == 0 _then x _else x + _true").run_columns(columns), "add of non-number");
+    CHECK_THROWS_WITH(Program("_fun (a) x").run_columns({{"x", x}}), "run_columns needs a number or boolean result");
+    CHECK_THROWS_WITH(Program("x + z").run_columns({{"x", x}}), "free variable: z");
+    CHECK_THROWS_WITH(formula.run_columns({{"x", x}, {"y", {1, 2}}}), "columns differ in length");
+    CHECK_THROWS_WITH(formula.run_columns({{"x", x}, {"yy", y}}), "program has no free variable yy");
+    CHECK(formula.run_columns({}).empty());
+    
+    //a block that overflows an int along the way is run row by row, and
+    //only a result that doesn't fit is an error
+    std::vector<int> big = x;
+    big[3] = 2147483647;
+    big[ColumnPlan::BLOCK + 3] = -2147483647 - 1;
+    Program back("big * 3 + big * -2");
+    CHECK(same_as_rows(back, {{"big", big}}));
+    CHECK_THROWS_WITH(Program("big + 1").run_columns({{"big", big}}), "run_columns result does not fit in an int");
+    CHECK(Program("_if big == 12345 _then 3000000000 _else 1").run_columns({{"big", big}}).size() == big.size());
+}
@@ -0,0 +1,70 @@
+//
+//  Columns.h
+//  msdscript
+//
+
+#ifndef Columns_h
+#define Columns_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "pointer.h"
+
+class Expr;
+
+//a program compiled to evaluate a block of rows at a time, with one
+//register of BLOCK ints per expression. Each op is a flat loop over its
+//registers, which the compiler turns into SIMD code; _if computes both
+//branches and picks one per row. Booleans are held as 1 and 0
+class ColumnPlan {
+public:
+    static const int BLOCK = 256;
+    
+    ColumnPlan();
+    
+    //false if e uses anything besides numbers, booleans, +, *, ==, _if,
+    //_let and the variables in inputs, or could fail for some rows, such
+    //as adding a boolean
+    bool compile(PTR(Expr) e, const std::vector<std::string> &inputs);
+    //columns[i] holds the rows of inputs[i] from compile; writes one
+    //value per row to out, except in blocks where some value didn't fit
+    //in an int, whose first rows are added to overflowed instead
+    void run(const std::vector<const int *> &columns, size_t rows, int *out, std::vector<size_t> *overflowed);
+    bool result_is_bool();
+    
+private:
+    typedef enum {
+        op_add,
+        op_mult,
+        op_eq,
+        op_select
+    } op_kind_t;
+    struct Op {
+        op_kind_t kind;
+        int dst, a, b, c;
+    };
+    typedef enum {
+        reg_op,
+        reg_const,
+        reg_input
+    } reg_kind_t;
+    struct Reg {
+        reg_kind_t kind;
+        bool is_bool;
+        //the constant, or the index of the input
+        int val;
+    };
+    
+    std::vector<Op> ops;
+    std::vector<Reg> regs;
+    std::vector<std::string> inputs;
+    std::vector<int> input_regs;
+    int result;
+    
+    int compile_expr(PTR(Expr) e, std::vector<std::pair<std::string, int>> &scope);
+    int add_reg(reg_kind_t kind, bool is_bool, int val);
+    int add_op(op_kind_t kind, bool is_bool, int a, int b, int c = -1);
+};
+
+#endif /* Columns_h */
@@ -7,13 +7,18 @@
 
 #include "Cont.h"
 #include "Val.h"
+#include "Env.h"
+#include "Expr.h"
+#include "Memo.h"
 
 PTR(Cont) Cont::done = NEW(DoneCont)();
 
 RightThenAddCont::RightThenAddCont(PTR(Expr) rhs, PTR(Env) env, PTR(Cont) rest) {
+    this->kind = KIND;
     this->rhs = rhs;
     this->env = env;
     this->rest = rest;
+    this->depth = rest->depth + 1;
 }
 
 void RightThenAddCont::step_continue() {
@@ -25,8 +30,10 @@ void RightThenAddCont::step_continue() {
 }
 
 AddCont::AddCont(PTR(Val) lhs_val, PTR(Cont) rest) {
+    this->kind = KIND;
     this->lhs_val = lhs_val;
     this->rest = rest;
+    this->depth = rest->depth + 1;
 }
 
 void AddCont::step_continue() {
@@ -37,9 +44,11 @@ void AddCont::step_continue() {
 }
 
 RightThenMultCont::RightThenMultCont(PTR(Expr) rhs, PTR(Env) env, PTR(Cont) rest) {
+    this->kind = KIND;
     this->rhs = rhs;
     this->env = env;
     this->rest = rest;
+    this->depth = rest->depth + 1;
 }
 
 void RightThenMultCont::step_continue() {
@@ -51,8 +60,10 @@ void RightThenMultCont::step_continue() {
 }
 
 MultCont::MultCont(PTR(Val) lhs_val, PTR(Cont) rest) {
+    this->kind = KIND;
     this->lhs_val = lhs_val;
     this->rest = rest;
+    this->depth = rest->depth + 1;
 }
 
 void MultCont::step_continue() {
@@ -63,10 +74,12 @@ void MultCont::step_continue() {
 }
 
 IfBranchCont::IfBranchCont(PTR(Expr) then_part,  PTR(Expr) else_part, PTR(Env) env, PTR(Cont) rest) {
+    this->kind = KIND;
     this->then_part = then_part;
     this->else_part = else_part;
     this->env = env;
     this->rest = rest;
+    this->depth = rest->depth + 1;
 }
 
 void IfBranchCont::step_continue() {
@@ -81,10 +94,12 @@ void IfBranchCont::step_continue() {
 }
 
 LetBodyCont::LetBodyCont(std::string lhs, PTR(Expr) body, PTR(Env) env, PTR(Cont) cont ) {
+    this->kind = KIND;
     this->lhs = lhs;
     this->body = body;
     this->env = env;
     this->rest = cont;
+    this->depth = cont->depth + 1;
 }
 
 void LetBodyCont::step_continue(){
@@ -95,9 +110,11 @@ void LetBodyCont::step_continue(){
 }
 
 ArgThenCallCont::ArgThenCallCont(PTR(Expr) actual_arg, PTR(Env) env, PTR(Cont) cont){
+    this->kind = KIND;
     this->actual_arg = actual_arg;
     this->env = env;
     this->rest = cont;
+    this->depth = cont->depth + 1;
 }
 
 void ArgThenCallCont::step_continue() {
@@ -108,22 +125,31 @@ void ArgThenCallCont::step_continue() {
 }
 
 CallCont::CallCont(PTR(Val) to_be_called_val, PTR(Cont) rest) {
+    this->kind = KIND;
     this->to_be_called_val = to_be_called_val;
     this->rest = rest;
+    this->depth = rest->depth + 1;
 }
 
 void CallCont::step_continue() {
     to_be_called_val->call_step(Step::val, rest);
 }
 
+DoneCont::DoneCont() {
+    this->kind = KIND;
+    this->depth = 0;
+}
+
 void DoneCont::step_continue() {
     throw std::runtime_error("cannot continue done");
 }
 
 RightThenEqCont::RightThenEqCont(PTR(Expr) rhs, PTR(Env) env, PTR(Cont) rest) {
+    this->kind = KIND;
     this->rhs = rhs;
     this->env = env;
     this->rest = rest;
+    this->depth = rest->depth + 1;
 }
 
 void RightThenEqCont::step_continue() {
@@ -135,8 +161,10 @@ void RightThenEqCont::step_continue() {
 }
 
 EqCont::EqCont(PTR(Val) lhs_val, PTR(Cont) rest) {
+    this->kind = KIND;
     this->lhs_val = lhs_val;
     this->rest = rest;
+    this->depth = rest->depth + 1;
 }
 
 void EqCont::step_continue() {
@@ -145,3 +173,115 @@ void EqCont::step_continue() {
     Step::val = NEW(BoolVal)(lhs_val->equals(rhs_val));
     Step::cont = rest;
 }
+
+LetRecBodyCont::LetRecBodyCont(PTR(ExtendedEnv) env, PTR(Expr) body, PTR(Cont) rest){
+    this->kind = KIND;
+    this->env = env;
+    this->body = body;
+    this->rest = rest;
+    this->depth = rest->depth + 1;
+}
+
+void LetRecBodyCont::step_continue(){
+    env->val = Step::val;
+    Step::mode = Step::interp_mode;
+    Step::expr = body;
+    Step::env = env;
+    Step::cont = rest;
+}
+
+ChainHeadCont::ChainHeadCont(PTR(CallExpr) call, PTR(Env) env, PTR(Cont) rest){
+    this->kind = KIND;
+    this->call = call;
+    this->env = env;
+    this->rest = rest;
+    this->depth = rest->depth + 1;
+}
+
+void ChainHeadCont::step_continue(){
+    PTR(FunVal) fun = KIND_CAST(FunVal)(Step::val);
+    if(fun != NULL && fun->arity() >= call->chain){
+        PTR(FrameEnv) frame = fun->frame(call->chain);
+        Step::mode = Step::interp_mode;
+        Step::expr = call->arg(0);
+        Step::env = env;
+        Step::cont = NEW(ChainArgCont)(call, fun, frame, env, rest);
+        return;
+    }
+    PTR(NativeFunVal) native = KIND_CAST(NativeFunVal)(Step::val);
+    if(native != NULL && native->bound_count == 0 && native->arity == call->chain){
+        Step::mode = Step::interp_mode;
+        Step::expr = call->arg(0);
+        Step::env = env;
+        Step::cont = NEW(NativeArgCont)(call, native, env, rest);
+        return;
+    }
+    //anything else is called one argument at a time, as if never chained
+    PTR(Cont) cont = rest;
+    for(int i = call->chain - 1; i >= 0; i--)
+        cont = NEW(ArgThenCallCont)(call->arg(i), env, cont);
+    Step::mode = Step::continue_mode;
+    Step::cont = cont;
+}
+
+ChainArgCont::ChainArgCont(PTR(CallExpr) call, PTR(FunVal) fun, PTR(FrameEnv) frame, PTR(Env) env, PTR(Cont) rest){
+    this->kind = KIND;
+    this->call = call;
+    this->fun = fun;
+    this->frame = frame;
+    this->env = env;
+    this->rest = rest;
+    this->next = 0;
+    this->depth = rest->depth + 1;
+}
+
+void ChainArgCont::step_continue(){
+    frame->vals[next++] = Step::val;
+    if(next < frame->count){
+        Step::mode = Step::interp_mode;
+        Step::expr = call->arg(next);
+        Step::env = env;
+        Step::cont = THIS;
+        return;
+    }
+    fun->call_frame_step(frame, rest);
+}
+
+NativeArgCont::NativeArgCont(PTR(CallExpr) call, PTR(NativeFunVal) native, PTR(Env) env, PTR(Cont) rest){
+    this->kind = KIND;
+    this->call = call;
+    this->native = native;
+    this->env = env;
+    this->rest = rest;
+    this->next = 0;
+    this->depth = rest->depth + 1;
+}
+
+void NativeArgCont::step_continue(){
+    vals[next++] = Step::val;
+    if(next < native->arity){
+        Step::mode = Step::interp_mode;
+        Step::expr = call->arg(next);
+        Step::env = env;
+        Step::cont = THIS;
+        return;
+    }
+    Step::mode = Step::continue_mode;
+    Step::val = native->call_native(vals);
+    Step::cont = rest;
+}
+
+MemoStoreCont::MemoStoreCont(PTR(Val) fun, PTR(Val) *args, int count, PTR(Cont) rest){
+    this->kind = KIND;
+    this->fun = fun;
+    for(int i = 0; i < count; i++)
+        this->args[i] = args[i];
+    this->count = count;
+    this->rest = rest;
+    this->depth = rest->depth + 1;
+}
+
+void MemoStoreCont::step_continue(){
+    Memo::store(fun, args, count, Step::val);
+    Step::cont = rest;
+}
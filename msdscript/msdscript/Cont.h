@@ -20,14 +20,41 @@ class Val;
 class VarExpr;
 class Cont;
 
+typedef enum {
+    cont_kind_done,
+    cont_kind_right_then_add,
+    cont_kind_add,
+    cont_kind_right_then_mult,
+    cont_kind_mult,
+    cont_kind_if_branch,
+    cont_kind_let_body,
+    cont_kind_right_then_eq,
+    cont_kind_eq,
+    cont_kind_arg_then_call,
+    cont_kind_call,
+    cont_kind_letrec_body,
+    cont_kind_chain_head,
+    cont_kind_chain_arg,
+    cont_kind_native_arg,
+    cont_kind_memo_store
+} cont_kind_t;
+
 CLASS(Cont) {
 public:
+    //which continuation this is
+    cont_kind_t kind;
+    //how many continuations are waiting underneath this one
+    long depth;
+    
     virtual void step_continue() = 0;
     static PTR(Cont) done;
 };
 
 class DoneCont : public Cont{
 public:
+    static const cont_kind_t KIND = cont_kind_done;
+    
+    DoneCont();
     void step_continue();
 };
 
@@ -36,6 +63,7 @@ public:
     PTR(Expr) rhs;
     PTR(Env) env;
     PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_right_then_add;
 
     RightThenAddCont(PTR(Expr) rhs, PTR(Env) env, PTR(Cont) rest);
     void step_continue();
@@ -45,6 +73,7 @@ class AddCont : public Cont{
 public:
     PTR(Val) lhs_val;
     PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_add;
 
     AddCont(PTR(Val) lhs_val, PTR(Cont) rest);
 
@@ -56,6 +85,7 @@ public:
     PTR(Expr) rhs;
     PTR(Env) env;
     PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_right_then_mult;
 
     RightThenMultCont(PTR(Expr) rhs, PTR(Env) env, PTR(Cont) rest);
     void step_continue();
@@ -65,6 +95,7 @@ class MultCont : public Cont{
 public:
     PTR(Val) lhs_val;
     PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_mult;
 
     MultCont(PTR(Val) lhs_val, PTR(Cont) rest);
 
@@ -77,6 +108,7 @@ public:
     PTR(Expr) else_part;
     PTR(Env) env;
     PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_if_branch;
 
     IfBranchCont(PTR(Expr) then_part,  PTR(Expr) else_part, PTR(Env) env, PTR(Cont) rest);
 
@@ -89,6 +121,7 @@ public:
     PTR(Expr) body;
     PTR(Env) env;
     PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_let_body;
 
     LetBodyCont(std::string lhs, PTR(Expr) body, PTR(Env) env, PTR(Cont) cont);
     void step_continue();
@@ -100,6 +133,7 @@ public:
     PTR(Expr) rhs;
     PTR(Env) env;
     PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_right_then_eq;
 
     RightThenEqCont(PTR(Expr) rhs, PTR(Env) env, PTR(Cont) rest);
     void step_continue();
@@ -109,6 +143,7 @@ class EqCont : public Cont{
 public:
     PTR(Val) lhs_val;
     PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_eq;
 
     EqCont(PTR(Val) lhs_val, PTR(Cont) rest);
 
@@ -120,19 +155,98 @@ public:
     PTR(Expr) actual_arg;
     PTR(Env) env;
     PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_arg_then_call;
     ArgThenCallCont(PTR(Expr) actual_arg, PTR(Env) env, PTR(Cont) cont);
 
     void step_continue();
 };
 
+class ExtendedEnv;
+
 class CallCont : public Cont{
 public:
     PTR(Val) to_be_called_val;
     PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_call;
 
     CallCont(PTR(Val) to_be_called_val, PTR(Cont) rest);
     void step_continue();
 
 };
 
+class LetRecBodyCont : public Cont{
+public:
+    PTR(ExtendedEnv) env;
+    PTR(Expr) body;
+    PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_letrec_body;
+    
+    LetRecBodyCont(PTR(ExtendedEnv) env, PTR(Expr) body, PTR(Cont) rest);
+    void step_continue();
+};
+
+class CallExpr;
+class FunVal;
+class NativeFunVal;
+class FrameEnv;
+
+//waits for the head of a chain of calls, then binds the whole chain in one
+//frame if the head is a curried function taking that many arguments, or
+//hands it to a native taking exactly that many
+class ChainHeadCont : public Cont{
+public:
+    PTR(CallExpr) call;
+    PTR(Env) env;
+    PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_chain_head;
+    
+    ChainHeadCont(PTR(CallExpr) call, PTR(Env) env, PTR(Cont) rest);
+    void step_continue();
+};
+
+//collects the arguments of a chain of calls into frame, one per continue;
+//reused for every argument, so the chain needs only this one continuation
+class ChainArgCont : public Cont{
+public:
+    PTR(CallExpr) call;
+    PTR(FunVal) fun;
+    PTR(FrameEnv) frame;
+    PTR(Env) env;
+    PTR(Cont) rest;
+    int next;
+    static const cont_kind_t KIND = cont_kind_chain_arg;
+    
+    ChainArgCont(PTR(CallExpr) call, PTR(FunVal) fun, PTR(FrameEnv) frame, PTR(Env) env, PTR(Cont) rest);
+    void step_continue();
+};
+
+//collects the arguments of a chain of calls for a native, like ChainArgCont,
+//so no partial copies of the native are made along the way
+class NativeArgCont : public Cont{
+public:
+    PTR(CallExpr) call;
+    PTR(NativeFunVal) native;
+    PTR(Val) vals[FrameEnv::MAX_SLOTS];
+    PTR(Env) env;
+    PTR(Cont) rest;
+    int next;
+    static const cont_kind_t KIND = cont_kind_native_arg;
+    
+    NativeArgCont(PTR(CallExpr) call, PTR(NativeFunVal) native, PTR(Env) env, PTR(Cont) rest);
+    void step_continue();
+};
+
+//records the value of a call in the memo table as it goes by
+class MemoStoreCont : public Cont{
+public:
+    PTR(Val) fun;
+    PTR(Val) args[FrameEnv::MAX_SLOTS];
+    int count;
+    PTR(Cont) rest;
+    static const cont_kind_t KIND = cont_kind_memo_store;
+    
+    MemoStoreCont(PTR(Val) fun, PTR(Val) *args, int count, PTR(Cont) rest);
+    void step_continue();
+};
+
 #endif /* Cont_hpp */
@@ -6,6 +6,8 @@
 //
 
 #include "Env.h"
+#include "Stats.h"
+#include <stdexcept>
 
 PTR(Env) Env::empty = NEW(EmptyEnv)();
 
@@ -21,12 +23,39 @@ ExtendedEnv::ExtendedEnv(std::string name, PTR(Val) val, PTR(Env) rest){
     this->name = name;
     this->val = val;
     this->rest = rest;
+    if(Stats::enabled)
+        Stats::envs++;
 }
 
 PTR(Val) ExtendedEnv::lookup(std::string find_name){
-    if(find_name == name)
+    if(Stats::enabled)
+        Stats::lookup_links++;
+    if(find_name == name){
+        //a _letrec slot is empty until its right-hand side has a value
+        if(val == NULL)
+            throw std::runtime_error("_letrec variable used before it has a value: " + name);
         return val;
-    else
+    }else
         return rest->lookup(find_name);
 }
 
+
+FrameEnv::FrameEnv(int count, PTR(Val) fun, PTR(Expr) body, PTR(Env) rest){
+    this->count = count;
+    this->fun = fun;
+    this->body = body;
+    this->rest = rest;
+    if(Stats::enabled)
+        Stats::frames++;
+}
+
+PTR(Val) FrameEnv::lookup(std::string find_name){
+    if(Stats::enabled)
+        Stats::lookup_links++;
+    //later formals shadow earlier ones, as the nested _funs would
+    for(int i = count - 1; i >= 0; i--){
+        if(find_name == *names[i])
+            return vals[i];
+    }
+    return rest->lookup(find_name);
+}
@@ -13,6 +13,7 @@
 #include "pointer.h"
 
 class Val;
+class Expr;
 
 class Env {
 public:
@@ -38,4 +39,24 @@ public:
     PTR(Val) lookup(std::string find_name);
 };
 
+//one frame for a saturated call of a curried function: the formals of
+//count directly nested _funs bound to their arguments at once, instead of
+//one ExtendedEnv and one FunVal per argument
+class FrameEnv : public Env{
+public:
+    static const int MAX_SLOTS = 8;
+    int count;
+    //point into fun and the _funs in its body
+    const std::string *names[MAX_SLOTS];
+    PTR(Val) vals[MAX_SLOTS];
+    PTR(Val) fun;
+    //what is left under the last of the count _funs
+    PTR(Expr) body;
+    PTR(Env) rest;
+    
+    FrameEnv(int count, PTR(Val) fun, PTR(Expr) body, PTR(Env) rest);
+    
+    PTR(Val) lookup(std::string find_name);
+};
+
 #endif /* Env_h */
@@ -10,9 +10,46 @@
 #include "Parse.h"
 #include "Val.h"
 #include "Step.h"
+#include "Stats.h"
+#include "Profile.h"
 #include "Cont.h"
 #include <stdexcept>
 
+ColumnBuf::ColumnBuf(std::streambuf *dest){
+    this->dest = dest;
+    this->column = 0;
+}
+
+int ColumnBuf::overflow(int c){
+    if(c == traits_type::eof())
+        return traits_type::not_eof(c);
+    if(c == '\n')
+        column = 0;
+    else
+        column++;
+    return dest->sputc(c);
+}
+
+std::streamsize ColumnBuf::xsputn(const char *s, std::streamsize n){
+    std::streamsize i = n;
+    while(i > 0 && s[i - 1] != '\n')
+        i--;
+    if(i == 0)
+        column += n;
+    else
+        column = n - i;
+    return dest->sputn(s, n);
+}
+
+int ColumnBuf::sync(){
+    return dest->pubsync();
+}
+
+//mixes v into seed, the same recipe as boost::hash_combine
+static size_t hash_combine(size_t seed, size_t v){
+    return seed ^ (v + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
 std::string Expr::to_string(){
     std::ostream output(nullptr);
     std::stringbuf strBuf;
@@ -21,6 +58,15 @@ std::string Expr::to_string(){
     return strBuf.str();
 }
 
+void Expr::pretty_print(std::ostream& output){
+    ColumnBuf columns(output.rdbuf());
+    std::ostream out(&columns);
+    out.copyfmt(output);
+    pretty_print_at(out, print_group_none, &columns.column);
+    if(!out)
+        output.setstate(std::ios::badbit);
+}
+
 std::string Expr::pp_to_string(){
     std::ostream output(nullptr);
     std::stringbuf strBuf;
@@ -29,20 +75,38 @@ std::string Expr::pp_to_string(){
     return strBuf.str();
 }
 
-NumExpr::NumExpr(int val) {
+NumExpr::NumExpr(int64_t val) {
+    this->kind = KIND;
     this->numVal = NEW(NumVal)(val);
     this->val = val;
+    this->hash = hash_combine(KIND, std::hash<int64_t>()(val));
+}
+
+PTR(NumExpr) NumExpr::literal(std::string digits){
+    PTR(Val) num = BigVal::parse(digits);
+    PTR(NumVal) small = KIND_CAST(NumVal)(num);
+    if(small != NULL)
+        return NEW(NumExpr)(small->val);
+    PTR(NumExpr) e = NEW(NumExpr)(0);
+    e->numVal = num;
+    e->hash = hash_combine(KIND, std::hash<std::string>()(num->to_string()));
+    return e;
 }
 
 bool NumExpr::equals(PTR(Expr) other){
-    PTR(NumExpr) num = CAST(NumExpr)(other);
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(NumExpr) num = KIND_CAST(NumExpr)(other);
     if(num == NULL)
         return false;
     else
-        return this->val == num->val;
+        return this->val == num->val && this->numVal->equals(num->numVal);
 }
 
 PTR(Val) NumExpr::interp(PTR(Env) env){
+    ProfileScope scope(this);
     return numVal;
 }
 
@@ -52,24 +116,26 @@ void NumExpr::step_interp() {
 }
 
 void NumExpr::print(std::ostream& output){
-    output << this->val;
-}
-
-void NumExpr::pretty_print(std::ostream& output){
-    this->pretty_print_at(output, print_group_none, 0);
+    numVal->print(output);
 }
 
 void NumExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
-    output << this->val;
+    numVal->print(output);
 }
 
 AddExpr::AddExpr(PTR(Expr) lhs, PTR(Expr) rhs) {
+    this->kind = KIND;
     this->lhs = lhs;
     this->rhs = rhs;
+    this->hash = hash_combine(hash_combine(KIND, lhs->hash), rhs->hash);
 }
 
 bool AddExpr::equals(PTR(Expr) other){
-    PTR(AddExpr) o = CAST(AddExpr)(other);
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(AddExpr) o = KIND_CAST(AddExpr)(other);
     if(o == NULL)
         return false;
     else
@@ -77,6 +143,7 @@ bool AddExpr::equals(PTR(Expr) other){
 }
 
 PTR(Val) AddExpr::interp(PTR(Env) env){
+    ProfileScope scope(this);
     return this->lhs->interp(env)->add_to(this->rhs->interp(env));
 }
 
@@ -94,14 +161,6 @@ void AddExpr::print(std::ostream& output){
     output << ")";
 }
 
-void AddExpr::pretty_print(std::ostream& output){
-    long pos = 0;
-    long *positionPtr = &pos;
-    lhs->pretty_print_at(output, print_group_add_or_let, positionPtr);
-    output << " + ";
-    rhs->pretty_print_at(output, print_group_add_or_eq, positionPtr);
-}
-
 void AddExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
     if(mode == print_group_add_or_let || mode == print_group_add || mode == print_group_add_or_mult_or_let)
         output << "(";
@@ -113,12 +172,18 @@ void AddExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos
 }
 
 MultExpr::MultExpr(PTR(Expr) lhs, PTR(Expr) rhs) {
+    this->kind = KIND;
     this->lhs = lhs;
     this->rhs = rhs;
+    this->hash = hash_combine(hash_combine(KIND, lhs->hash), rhs->hash);
 }
 
 bool MultExpr::equals(PTR(Expr) other){
-    PTR(MultExpr) o = CAST(MultExpr)(other);
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(MultExpr) o = KIND_CAST(MultExpr)(other);
     if(o == NULL)
         return false;
     else
@@ -126,6 +191,7 @@ bool MultExpr::equals(PTR(Expr) other){
 }
 
 PTR(Val) MultExpr::interp(PTR(Env) env){
+    ProfileScope scope(this);
     return this->lhs->interp(env)->mult_to(this->rhs->interp(env));
 }
 
@@ -143,14 +209,6 @@ void MultExpr::print(std::ostream& output){
     output << ")";
 }
 
-void MultExpr::pretty_print(std::ostream& output){
-    long pos = 0;
-    long *positionPtr = &pos;
-    lhs->pretty_print_at(output, print_group_add_or_mult_or_let, positionPtr);
-    output << " * ";
-    rhs->pretty_print_at(output, print_group_add, positionPtr);
-}
-
 void MultExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
     if(mode == print_group_add_or_mult_or_let){
         output << "(";
@@ -170,11 +228,17 @@ void MultExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *po
 }
 
 VarExpr::VarExpr(std::string var){
+    this->kind = KIND;
     this->var = var;
+    this->hash = hash_combine(KIND, std::hash<std::string>()(var));
 }
 
 bool VarExpr::equals(PTR(Expr) other){
-    PTR(VarExpr) o = CAST(VarExpr)(other);
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(VarExpr) o = KIND_CAST(VarExpr)(other);
     if(o == NULL)
         return false;
     else
@@ -182,11 +246,17 @@ bool VarExpr::equals(PTR(Expr) other){
 }
 
 PTR(Val) VarExpr::interp(PTR(Env) env){
+    ProfileScope scope(this);
+    if(Stats::enabled)
+        return Stats::counted_lookup(env, var);
     return env->lookup(var);
 }
 
 void VarExpr::step_interp() {
-    Step::val = Step::env->lookup(var);
+    if(Stats::enabled)
+        Step::val = Stats::counted_lookup(Step::env, var);
+    else
+        Step::val = Step::env->lookup(var);
     Step::mode = Step::continue_mode;
 }
 
@@ -194,22 +264,24 @@ void VarExpr::print(std::ostream& output){
     output << this->var;
 }
 
-void VarExpr::pretty_print(std::ostream& output){
-    output << this->var;
-}
-
 void VarExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
     output << this->var;
 }
 
 LetExpr::LetExpr(std::string lhs, PTR(Expr) rhs, PTR(Expr) body){
+    this->kind = KIND;
     this->lhs = lhs;
     this->rhs = rhs;
     this->body = body;
+    this->hash = hash_combine(hash_combine(hash_combine(KIND, std::hash<std::string>()(lhs)), rhs->hash), body->hash);
 }
 
 bool LetExpr::equals(PTR(Expr) other){
-    PTR(LetExpr) o = CAST(LetExpr)(other);
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(LetExpr) o = KIND_CAST(LetExpr)(other);
     if(o == NULL)
         return false;
     else
@@ -217,6 +289,7 @@ bool LetExpr::equals(PTR(Expr) other){
 }
 
 PTR(Val) LetExpr::interp(PTR(Env) env){
+    ProfileScope scope(this);
     PTR(Val) n = this->rhs->interp(env);
     PTR(Env) new_env = NEW(ExtendedEnv)(lhs, n, env);
     return this->body->interp(new_env);
@@ -238,27 +311,14 @@ void LetExpr::print(std::ostream& output){
     output << ")";
 }
 
-void LetExpr::pretty_print(std::ostream& output){
-    long pos = 0;
-    long *positionPtr = &pos;
-    output << "_let " << this->lhs << " = ";
-    this->rhs->pretty_print_at(output, print_group_none, positionPtr);
-    output << "\n";
-    *positionPtr = output.tellp();
-    output << "_in  ";
-    this->body->pretty_print_at(output, print_group_none, positionPtr);
-    
-}
 void LetExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
     if(mode == print_group_eq || mode == print_group_add_or_let || mode == print_group_add_or_mult_or_let)
         output << "(";
-    long letPos = output.tellp();
-    long spaces = letPos - *pos;
+    long spaces = *pos;
     output << "_let ";
     output << this->lhs << " = ";
     this->rhs->pretty_print_at(output, print_group_none, pos);
     output << "\n";
-    *pos = output.tellp();
     for(int i = 0; i < spaces; i++){
         output << " ";
     }
@@ -269,12 +329,18 @@ void LetExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos
 }
 
 BoolExpr::BoolExpr(bool boolVal) {
+    this->kind = KIND;
     this->bVal = NEW(BoolVal)(boolVal);
     this->boolVal = boolVal;
+    this->hash = hash_combine(KIND, boolVal);
 }
 
 bool BoolExpr::equals(PTR(Expr) other){
-    PTR(BoolExpr) b = CAST(BoolExpr)(other);
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(BoolExpr) b = KIND_CAST(BoolExpr)(other);
     if(b == NULL)
         return false;
     else
@@ -282,6 +348,7 @@ bool BoolExpr::equals(PTR(Expr) other){
 }
 
 PTR(Val) BoolExpr::interp(PTR(Env) env){
+    ProfileScope scope(this);
     return bVal;
 }
 
@@ -297,21 +364,23 @@ void BoolExpr::print(std::ostream& output){
         output << "_false";
 }
 
-void BoolExpr::pretty_print(std::ostream& output){
-    pretty_print_at(output, print_group_none, 0);
-}
-
 void BoolExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
     print(output);
 }
 
 EqExpr::EqExpr(PTR(Expr) lhs, PTR(Expr) rhs) {
+    this->kind = KIND;
     this->lhs = lhs;
     this->rhs = rhs;
+    this->hash = hash_combine(hash_combine(KIND, lhs->hash), rhs->hash);
 }
 
 bool EqExpr::equals(PTR(Expr) other){
-    PTR(EqExpr) e = CAST(EqExpr)(other);
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(EqExpr) e = KIND_CAST(EqExpr)(other);
     if(e == NULL)
         return false;
     else
@@ -319,6 +388,7 @@ bool EqExpr::equals(PTR(Expr) other){
 }
 
 PTR(Val) EqExpr::interp(PTR(Env) env){
+    ProfileScope scope(this);
     return NEW(BoolVal)(lhs->interp(env)->equals(rhs->interp(env)));
 }
 
@@ -337,14 +407,6 @@ void EqExpr::print(std::ostream& output){
     output << ")";
 }
 
-void EqExpr::pretty_print(std::ostream& output){
-    long pos = 0;
-    long *positionPtr = &pos;
-    lhs->pretty_print_at(output, print_group_eq, positionPtr);
-    output << " == ";
-    rhs->pretty_print_at(output, print_group_none, positionPtr);
-}
-
 void EqExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
     if(mode == print_group_none){
         lhs->pretty_print_at(output, print_group_eq, pos);
@@ -360,13 +422,19 @@ void EqExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos)
 }
 
 IfExpr::IfExpr(PTR(Expr) test_part, PTR(Expr) then_part, PTR(Expr) else_part){
+    this->kind = KIND;
     this->test_part = test_part;
     this->then_part = then_part;
     this->else_part = else_part;
+    this->hash = hash_combine(hash_combine(hash_combine(KIND, test_part->hash), then_part->hash), else_part->hash);
 }
 
 bool IfExpr::equals(PTR(Expr) other){
-    PTR(IfExpr) o = CAST(IfExpr)(other);
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(IfExpr) o = KIND_CAST(IfExpr)(other);
     if(o == NULL)
         return false;
     else
@@ -374,6 +442,7 @@ bool IfExpr::equals(PTR(Expr) other){
 }
 
 PTR(Val) IfExpr::interp(PTR(Env) env){
+    ProfileScope scope(this);
     if(test_part->interp(env)->is_true())
         return then_part->interp(env);
     else
@@ -396,36 +465,19 @@ void IfExpr::print(std::ostream& output){
     output << ")";
 }
 
-void IfExpr::pretty_print(std::ostream& output){
-    long pos = 0;
-    long *positionPtr = &pos;
-    output << "_if ";
-    this->test_part->pretty_print_at(output, print_group_none, positionPtr);
-    output << "\n";
-    *positionPtr = output.tellp();
-    output << "_then ";
-    this->then_part->pretty_print_at(output, print_group_none, positionPtr);
-    output << "\n";
-    *positionPtr = output.tellp();
-    output << "_else ";
-    this->else_part->pretty_print_at(output, print_group_none, positionPtr);
-}
 void IfExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
     if(mode == print_group_eq || mode == print_group_add_or_let || mode == print_group_add_or_mult_or_let)
         output << "(";
-    long letPos = output.tellp();
-    long spaces = letPos - *pos;
+    long spaces = *pos;
     output << "_if ";
     this->test_part->pretty_print_at(output, print_group_none, pos);
     output << "\n";
-    *pos = output.tellp();
     for(int i = 0; i < spaces; i++){
         output << " ";
     }
     output << "_then ";
     this->then_part->pretty_print_at(output, print_group_none, pos);
     output << "\n";
-    *pos = output.tellp();
     for(int i = 0; i < spaces; i++){
         output << " ";
     }
@@ -436,12 +488,20 @@ void IfExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos)
 }
 
 FunExpr::FunExpr(std::string formal_arg, PTR(Expr) body){
+    this->kind = KIND;
     this->formal_arg = formal_arg;
     this->body = body;
+    PTR(FunExpr) inner = KIND_CAST(FunExpr)(body);
+    this->arity = (inner == NULL) ? 1 : inner->arity + 1;
+    this->hash = hash_combine(hash_combine(KIND, std::hash<std::string>()(formal_arg)), body->hash);
 }
 
 bool FunExpr::equals(PTR(Expr) other){
-    PTR(FunExpr) o = CAST(FunExpr)(other);
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(FunExpr) o = KIND_CAST(FunExpr)(other);
     if(o == NULL)
         return false;
     else
@@ -449,6 +509,7 @@ bool FunExpr::equals(PTR(Expr) other){
 }
 
 PTR(Val) FunExpr::interp(PTR(Env) env){
+    ProfileScope scope(this);
     return NEW(FunVal)(this->formal_arg, this->body, env);
 }
 
@@ -473,20 +534,6 @@ void FunExpr::print(std::ostream& output){
     output << ")";
 }
 
-void FunExpr::pretty_print(std::ostream& output){
-//    long pos = 0;
-//    long *positionPtr = &pos;
-//    output << "_if ";
-//    this->test_part->pretty_print_at(output, print_group_none, positionPtr);
-//    output << "\n";
-//    *positionPtr = output.tellp();
-//    output << "_then ";
-//    this->then_part->pretty_print_at(output, print_group_none, positionPtr);
-//    output << "\n";
-//    *positionPtr = output.tellp();
-//    output << "_else ";
-//    this->else_part->pretty_print_at(output, print_group_none, positionPtr);
-}
 void FunExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
 //    if(mode == print_group_eq || mode == print_group_add_or_let || mode == print_group_add_or_mult_or_let)
 //        output << "(";
@@ -513,26 +560,71 @@ void FunExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos
 }
 
 CallExpr::CallExpr(PTR(Expr) to_be_called, PTR(Expr) actual_arg){
+    this->kind = KIND;
     this->to_be_called = to_be_called;
     this->actual_arg = actual_arg;
+    PTR(CallExpr) inner = KIND_CAST(CallExpr)(to_be_called);
+    this->chain = (inner == NULL) ? 1 : inner->chain + 1;
+    this->head = (inner == NULL) ? to_be_called : inner->head;
+    this->hash = hash_combine(hash_combine(KIND, to_be_called->hash), actual_arg->hash);
+}
+
+PTR(Expr) CallExpr::arg(int i){
+    CallExpr *c = this;
+    for(int n = chain - 1; n > i; n--)
+        c = &*KIND_CAST(CallExpr)(c->to_be_called);
+    return c->actual_arg;
 }
 
 bool CallExpr::equals(PTR(Expr) other){
-    PTR(CallExpr) c = CAST(CallExpr)(other);
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(CallExpr) c = KIND_CAST(CallExpr)(other);
     if(c == NULL)
         return false;
     else
         return (this->to_be_called->equals(c->to_be_called) && this->actual_arg->equals(c->actual_arg));
 }
 
+//a chain of calls whose head turns out to be a curried function taking at
+//least that many arguments is bound in one frame; the partial applications
+//in between could only have made closures, so skipping them changes nothing
 PTR(Val) CallExpr::interp(PTR(Env) env){
-    return this->to_be_called->interp(env)->call(this->actual_arg->interp(env));
+    ProfileScope scope(this);
+    if(chain < 2 || chain > FrameEnv::MAX_SLOTS)
+        return this->to_be_called->interp(env)->call(this->actual_arg->interp(env));
+    PTR(Val) f = head->interp(env);
+    PTR(FunVal) fun = KIND_CAST(FunVal)(f);
+    if(fun != NULL && fun->arity() >= chain){
+        PTR(FrameEnv) frame = fun->frame(chain);
+        for(int i = 0; i < chain; i++)
+            frame->vals[i] = arg(i)->interp(env);
+        return fun->call_frame(frame);
+    }
+    //a native taking exactly the whole chain needs no partial copies either
+    PTR(NativeFunVal) native = KIND_CAST(NativeFunVal)(f);
+    if(native != NULL && native->bound_count == 0 && native->arity == chain){
+        PTR(Val) vals[NativeFunVal::MAX_ARITY];
+        for(int i = 0; i < chain; i++)
+            vals[i] = arg(i)->interp(env);
+        return native->call_native(vals);
+    }
+    for(int i = 0; i < chain; i++)
+        f = f->call(arg(i)->interp(env));
+    return f;
 }
 
 void CallExpr::step_interp() {
     Step::mode = Step::interp_mode;
-    Step::expr = to_be_called;
-    Step::cont = NEW(ArgThenCallCont)(actual_arg, Step::env, Step::cont);
+    if(chain < 2 || chain > FrameEnv::MAX_SLOTS){
+        Step::expr = to_be_called;
+        Step::cont = NEW(ArgThenCallCont)(actual_arg, Step::env, Step::cont);
+        return;
+    }
+    Step::expr = head;
+    Step::cont = NEW(ChainHeadCont)(STATIC_CAST(CallExpr)(THIS), Step::env, Step::cont);
 }
 
 void CallExpr::print(std::ostream& output){
@@ -542,20 +634,6 @@ void CallExpr::print(std::ostream& output){
       output << ")";
 }
 
-void CallExpr::pretty_print(std::ostream& output){
-//    long pos = 0;
-//    long *positionPtr = &pos;
-//    output << "_if ";
-//    this->test_part->pretty_print_at(output, print_group_none, positionPtr);
-//    output << "\n";
-//    *positionPtr = output.tellp();
-//    output << "_then ";
-//    this->then_part->pretty_print_at(output, print_group_none, positionPtr);
-//    output << "\n";
-//    *positionPtr = output.tellp();
-//    output << "_else ";
-//    this->else_part->pretty_print_at(output, print_group_none, positionPtr);
-}
 void CallExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
 //    if(mode == print_group_eq || mode == print_group_add_or_let || mode == print_group_add_or_mult_or_let)
 //        output << "(";
@@ -581,6 +659,68 @@ void CallExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *po
 //        output << ")";
 }
 
+LetRecExpr::LetRecExpr(std::string lhs, PTR(Expr) rhs, PTR(Expr) body){
+    this->kind = KIND;
+    this->lhs = lhs;
+    this->rhs = rhs;
+    this->body = body;
+    this->hash = hash_combine(hash_combine(hash_combine(KIND, std::hash<std::string>()(lhs)), rhs->hash), body->hash);
+}
+
+bool LetRecExpr::equals(PTR(Expr) other){
+    if(other == NULL || other->hash != this->hash)
+        return false;
+    if(&*other == this)
+        return true;
+    PTR(LetRecExpr) o = KIND_CAST(LetRecExpr)(other);
+    if(o == NULL)
+        return false;
+    else
+        return (this->lhs == o->lhs && this->rhs->equals(o->rhs) && this->body->equals(o->body));
+}
+
+PTR(Val) LetRecExpr::interp(PTR(Env) env){
+    ProfileScope scope(this);
+    PTR(ExtendedEnv) new_env = NEW(ExtendedEnv)(lhs, nullptr, env);
+    new_env->val = this->rhs->interp(new_env);
+    return this->body->interp(new_env);
+}
+
+void LetRecExpr::step_interp() {
+    PTR(ExtendedEnv) new_env = NEW(ExtendedEnv)(lhs, nullptr, Step::env);
+    Step::mode = Step::interp_mode;
+    Step::expr = rhs;
+    Step::env = new_env;
+    Step::cont = NEW(LetRecBodyCont)(new_env, body, Step::cont);
+}
+
+void LetRecExpr::print(std::ostream& output){
+    output << "(_letrec ";
+    output << lhs;
+    output << "=";
+    rhs->print(output);
+    output << " _in ";
+    body->print(output);
+    output << ")";
+}
+
+void LetRecExpr::pretty_print_at(std::ostream& output, print_mode_t mode, long *pos){
+    if(mode == print_group_eq || mode == print_group_add_or_let || mode == print_group_add_or_mult_or_let)
+        output << "(";
+    long spaces = *pos;
+    output << "_letrec ";
+    output << this->lhs << " = ";
+    this->rhs->pretty_print_at(output, print_group_none, pos);
+    output << "\n";
+    for(int i = 0; i < spaces; i++){
+        output << " ";
+    }
+    output << "_in     ";
+    this->body->pretty_print_at(output, print_group_none, pos);
+    if(mode == print_group_eq ||mode == print_group_add_or_let || mode == print_group_add_or_mult_or_let)
+        output << ")";
+}
+
 TEST_CASE("Expression Tests"){
     std::stringstream ss;
     PTR(NumExpr)num1 = NEW(NumExpr)(1);
@@ -822,5 +962,167 @@ TEST_CASE("Expression Tests"){
     CHECK(Step::interp_by_steps(parse_str("_if 1==1 _then 2*2 _else 3"))->equals(NEW(NumVal)(4)));
     CHECK(Step::interp_by_steps(parse_str("_let f = _fun (x) x + 1 _in  f(10)"))->equals(NEW(NumVal)(11)));
     CHECK(Step::interp_by_steps(parse_str("(_fun (x) x + 1)(5)"))->equals(NEW(NumVal)(6)));
+    
+    Step::interp_by_steps(parse_str("1"));
+    CHECK(Step::steps == 1);
+    Step::interp_by_steps(parse_str("2+2"));
+    CHECK(Step::steps == 5);
 
 };
+
+TEST_CASE("Expression Hash"){
+    PTR(Expr) fact = parse_str("_fun (f) _fun (n) _if n == 1 _then 1 _else n * f(f)(n + -1)");
+    PTR(Expr) same = parse_str("_fun (f) _fun (n) _if n == 1 _then 1 _else n * f(f)(n + -1)");
+    PTR(Expr) other = parse_str("_fun (f) _fun (n) _if n == 1 _then 1 _else n * f(f)(n + -2)");
+    CHECK(fact->hash == same->hash);
+    CHECK(fact->hash != other->hash);
+    CHECK(fact->equals(same));
+    CHECK(fact->equals(fact));
+    CHECK(fact->equals(other) == false);
+    CHECK((NEW(AddExpr)(NEW(NumExpr)(1), NEW(NumExpr)(2)))->hash != (NEW(MultExpr)(NEW(NumExpr)(1), NEW(NumExpr)(2)))->hash);
+    CHECK((NEW(AddExpr)(NEW(NumExpr)(1), NEW(NumExpr)(2)))->hash != (NEW(AddExpr)(NEW(NumExpr)(2), NEW(NumExpr)(1)))->hash);
+    CHECK((NEW(LetExpr)("x", NEW(NumExpr)(1), NEW(VarExpr)("x")))->hash != (NEW(LetExpr)("y", NEW(NumExpr)(1), NEW(VarExpr)("x")))->hash);
+    
+    PTR(Val) f1 = fact->interp(Env::empty);
+    PTR(Val) f2 = same->interp(Env::empty);
+    CHECK(f1->equals(f1));
+    CHECK(f1->equals(f2));
+    CHECK(f1->equals(other->interp(Env::empty)) == false);
+}
+
+TEST_CASE("Kind Tags"){
+    PTR(Expr) e = parse_str("_let f = _fun (x) x * 2 _in f(3) + 1 == 7");
+    CHECK(e->kind == expr_kind_let);
+    PTR(LetExpr) let = KIND_CAST(LetExpr)(e);
+    CHECK(let->rhs->kind == expr_kind_fun);
+    CHECK(let->body->kind == expr_kind_eq);
+    CHECK((KIND_CAST(AddExpr)(let->body) == NULL));
+    CHECK(KIND_CAST(EqExpr)(let->body)->lhs->kind == expr_kind_add);
+    PTR(Expr) none = NULL;
+    CHECK((KIND_CAST(NumExpr)(none) == NULL));
+    
+    PTR(Val) t = NEW(BoolVal)(true);
+    PTR(Val) sum = (NEW(NumVal)(2))->add_to(NEW(NumVal)(3));
+    CHECK(e->interp(Env::empty)->kind == val_kind_bool);
+    CHECK(let->rhs->interp(Env::empty)->kind == val_kind_fun);
+    CHECK(KIND_CAST(NumVal)(sum)->val == 5);
+    CHECK((KIND_CAST(NumVal)(t) == NULL));
+    CHECK(Cont::done->kind == cont_kind_done);
+    CHECK((NEW(AddCont)(sum, Cont::done))->kind == cont_kind_add);
+}
+
+//a sink that cannot seek, so tellp() on a stream over it returns -1 like std::cout on a pipe
+class NoSeekBuf : public std::streambuf {
+public:
+    std::string text;
+protected:
+    int overflow(int c){
+        text += (char)c;
+        return c;
+    }
+};
+
+TEST_CASE("Pretty Print Without tellp"){
+    NoSeekBuf sink;
+    std::ostream output(&sink);
+    CHECK(output.tellp() == -1);
+    (NEW(MultExpr)(NEW(NumExpr)(5), NEW(LetExpr)("x", NEW(NumExpr)(5), NEW(LetExpr)("y", NEW(NumExpr)(3), NEW(AddExpr)(NEW(VarExpr)("x"), NEW(VarExpr)("y"))))))->pretty_print(output);
+    CHECK(sink.text == "5 * _let x = 5\n    _in  _let y = 3\n         _in  x + y");
+    
+    sink.text = "";
+    (NEW(EqExpr)(NEW(IfExpr)(NEW(BoolExpr)(true), NEW(NumExpr)(2), NEW(NumExpr)(-2)), NEW(IfExpr)(NEW(BoolExpr)(true), NEW(NumExpr)(5), NEW(NumExpr)(-5))))->pretty_print(output);
+    CHECK(sink.text == "(_if _true\n _then 2\n _else -2) == _if _true\n              _then 5\n              _else -5");
+    
+    std::stringstream ss;
+    ColumnBuf columns(ss.rdbuf());
+    std::ostream out(&columns);
+    out << "ab\ncde" << 42;
+    CHECK(columns.column == 5);
+    out << "\n";
+    CHECK(columns.column == 0);
+    CHECK(ss.str() == "ab\ncde42\n");
+}
+
+TEST_CASE("Letrec"){
+    std::string fact = "_letrec fact = _fun (n) _if n == 0 _then 1 _else n * fact(n + -1) _in fact(10)";
+    PTR(Expr) e = parse_str(fact);
+    CHECK(e->equals(NEW(LetRecExpr)("fact", NEW(FunExpr)("n", NEW(IfExpr)(NEW(EqExpr)(NEW(VarExpr)("n"), NEW(NumExpr)(0)), NEW(NumExpr)(1), NEW(MultExpr)(NEW(VarExpr)("n"), NEW(CallExpr)(NEW(VarExpr)("fact"), NEW(AddExpr)(NEW(VarExpr)("n"), NEW(NumExpr)(-1)))))), NEW(CallExpr)(NEW(VarExpr)("fact"), NEW(NumExpr)(10)))));
+    CHECK(!e->equals(parse_str("_let fact = _fun (n) _if n == 0 _then 1 _else n * fact(n + -1) _in fact(10)")));
+    CHECK(e->interp(Env::empty)->equals(NEW(NumVal)(3628800)));
+    CHECK(Step::interp_by_steps(e)->equals(NEW(NumVal)(3628800)));
+    CHECK(parse_str(e->to_string())->equals(e));
+    CHECK(parse_str("_letrec x = 1 _in x + 2")->pp_to_string() == "_letrec x = 1\n_in     x + 2");
+    CHECK(parse_str("1 + _letrec x = 1 _in x")->pp_to_string() == "1 + _letrec x = 1\n    _in     x");
+    
+    //a _letrec that needs its own value while computing it has nothing to find
+    CHECK_THROWS_WITH(parse_str("_letrec x = x + 1 _in x")->interp(Env::empty), "_letrec variable used before it has a value: x");
+    CHECK_THROWS_WITH(Step::interp_by_steps(parse_str("_letrec x = x + 1 _in x")), "_letrec variable used before it has a value: x");
+    
+    //deep recursion stays on the heap in the step machine
+    CHECK(Step::interp_by_steps(parse_str("_letrec count = _fun (n) _if n == 0 _then 0 _else 1 + count(n + -1) _in count(100000)"))->equals(NEW(NumVal)(100000)));
+    
+    //f(f)(n) is bound in one frame, so self-application makes no more
+    //closures or calls than _letrec does
+    PTR(Expr) self_applied = parse_str("_let fact = _fun (f) _fun (n) _if n == 0 _then 1 _else n * f(f)(n + -1) _in fact(fact)(10)");
+    Stats::reset();
+    Stats::enabled = true;
+    Step::interp_by_steps(self_applied);
+    long self_applied_calls = Stats::step_interps[expr_kind_call];
+    long self_applied_funs = Stats::vals[val_kind_fun];
+    Stats::reset();
+    Step::interp_by_steps(e);
+    Stats::enabled = false;
+    CHECK(Stats::step_interps[expr_kind_call] == self_applied_calls);
+    CHECK(Stats::vals[val_kind_fun] == 1);
+    CHECK(self_applied_funs == 1);
+}
+
+//value of in from both engines, which have to agree
+static std::string both_engines(std::string in){
+    PTR(Expr) e = parse_str(in);
+    std::string interp_out = e->interp(Env::empty)->to_string();
+    CHECK(Step::interp_by_steps(e)->to_string() == interp_out);
+    return interp_out;
+}
+
+TEST_CASE("Uncurrying"){
+    PTR(CallExpr) c = KIND_CAST(CallExpr)(parse_str("f(x)(y)(z)"));
+    CHECK(c->chain == 3);
+    CHECK(c->head->equals(NEW(VarExpr)("f")));
+    CHECK(c->arg(0)->equals(NEW(VarExpr)("x")));
+    CHECK(c->arg(2)->equals(NEW(VarExpr)("z")));
+    CHECK(KIND_CAST(CallExpr)(parse_str("f(x)"))->arg(0)->equals(NEW(VarExpr)("x")));
+    CHECK(KIND_CAST(FunExpr)(parse_str("_fun (a) _fun (b) _fun (c) a"))->arity == 3);
+    CHECK(KIND_CAST(FunExpr)(parse_str("_fun (a) (_let b = 1 _in _fun (c) a)"))->arity == 1);
+    
+    std::string add3 = "_let add = _fun (a) _fun (b) _fun (c) a + 10 * b + 100 * c _in ";
+    CHECK(both_engines(add3 + "add(1)(2)(3)") == "321");
+    //partly applied, over-applied and shadowing chains
+    CHECK(both_engines(add3 + "_let g = add(1)(2) _in g(3) + g(4)") == "742");
+    CHECK(both_engines("_let k = _fun (a) _fun (b) a _in k(_fun (x) x + 1)(2)(5)") == "6");
+    CHECK(both_engines("(_fun (x) _fun (x) x)(1)(2)") == "2");
+    CHECK(both_engines("_let z = 100 _in (_fun (a) _fun (b) a + b + z)(1)(2)") == "103");
+    CHECK(both_engines("_letrec pow = _fun (b) _fun (e) _if e == 0 _then 1 _else b * pow(b)(e + -1) _in pow(2)(10)") == "1024");
+    //longer than one frame holds
+    std::string nine = "(_fun (a) _fun (b) _fun (c) _fun (d) _fun (e) _fun (f) _fun (g) _fun (h) _fun (i) a + i)";
+    CHECK(both_engines(nine + "(1)(2)(3)(4)(5)(6)(7)(8)(9)") == "10");
+    CHECK_THROWS_WITH(parse_str("1(2)(3)")->interp(Env::empty), "calling not allowed on numval");
+    CHECK_THROWS_WITH(Step::interp_by_steps(parse_str("1(2)(3)")), "attempted to use call_step on a NumVal");
+    
+    //one frame and no closures besides add itself
+    PTR(Expr) e = parse_str(add3 + "add(1)(2)(3)");
+    Stats::reset();
+    Stats::enabled = true;
+    e->interp(Env::empty);
+    CHECK(Stats::vals[val_kind_fun] == 1);
+    CHECK(Stats::envs == 1);
+    CHECK(Stats::frames == 1);
+    Stats::reset();
+    Step::interp_by_steps(e);
+    Stats::enabled = false;
+    CHECK(Stats::vals[val_kind_fun] == 1);
+    CHECK(Stats::envs == 1);
+    CHECK(Stats::frames == 1);
+    CHECK(Stats::step_continues[cont_kind_chain_arg] == 3);
+    CHECK(Stats::step_continues[cont_kind_call] == 0);
+}
@@ -24,13 +24,53 @@ typedef enum {
     print_group_eq
 } print_mode_t;
 
+typedef enum {
+    expr_kind_num,
+    expr_kind_add,
+    expr_kind_mult,
+    expr_kind_var,
+    expr_kind_let,
+    expr_kind_bool,
+    expr_kind_eq,
+    expr_kind_if,
+    expr_kind_fun,
+    expr_kind_call,
+    expr_kind_letrec
+} expr_kind_t;
+
 class Val;
 
+//forwards characters to another streambuf while counting the column of the
+//next character, so pretty printing can indent without asking for tellp()
+class ColumnBuf : public std::streambuf {
+public:
+    std::streambuf *dest;
+    long column;
+    
+    ColumnBuf(std::streambuf *dest);
+    
+protected:
+    int overflow(int c);
+    std::streamsize xsputn(const char *s, std::streamsize n);
+    int sync();
+};
+
 CLASS(Expr) {
 public:
     
+    //tag naming the subclass, so hot paths can test the type without dynamic_cast
+    expr_kind_t kind;
+    
+    //structural hash computed in each constructor, equal expressions have equal hashes
+    size_t hash;
+    
+    //offsets in the parsed text of the first character and one past the last,
+    //or -1 for expressions not built by the parser from a seekable stream
+    int span_start = -1;
+    int span_end = -1;
+    
     virtual ~Expr() {};
-    //checks if 2 expressions are equal
+    //checks if 2 expressions are equal, rejecting on a hash mismatch before walking
     virtual bool equals(PTR(Expr)other) = 0;
     
     //returns the value of the Expression
@@ -42,9 +82,10 @@ public:
     virtual void print(std::ostream& output) = 0;
     
     //prints expression with spaces and no extra parenthesis
-    virtual void pretty_print(std::ostream& output) = 0;
+    void pretty_print(std::ostream& output);
     
-    //takes in a enum print mode to determine the correct format for printing an expression
+    //takes in a enum print mode to determine the correct format for printing an expression,
+    //pos points at the column of the next character written to output
     virtual void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos) = 0;
     
     //turns expression into a string for easy comparisons
@@ -56,16 +97,19 @@ public:
     
 class NumExpr : public Expr{
     public:
-        int val;
+        //0 when numVal is a BigVal
+        int64_t val;
     PTR(Val) numVal;
+    static const expr_kind_t KIND = expr_kind_num;
         
-    NumExpr(int val);
+    NumExpr(int64_t val);
+    //the literal for an optional '-' and then decimal digits, of any size
+    static PTR(NumExpr) literal(std::string digits);
     
     bool equals(PTR(Expr)other);
     PTR(Val) interp(PTR(Env) env);
     void step_interp();
     void print(std::ostream& output);
-    void pretty_print(std::ostream& output);
     void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
 };
     
@@ -73,6 +117,7 @@ class AddExpr : public Expr {
     public:
         PTR(Expr) lhs;
         PTR(Expr) rhs;
+    static const expr_kind_t KIND = expr_kind_add;
         
     AddExpr(PTR(Expr) lhs, PTR(Expr) rhs);
     
@@ -81,7 +126,6 @@ class AddExpr : public Expr {
     PTR(Val) interp(PTR(Env) env);
     void step_interp();
     void print(std::ostream& output);
-    void pretty_print(std::ostream& output);
     void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
 };
     
@@ -89,6 +133,7 @@ class MultExpr : public Expr {
     public:
         PTR(Expr) lhs;
         PTR(Expr) rhs;
+    static const expr_kind_t KIND = expr_kind_mult;
         
     MultExpr(PTR(Expr) lhs, PTR(Expr) rhs);
     
@@ -96,13 +141,13 @@ class MultExpr : public Expr {
     PTR(Val) interp(PTR(Env) env);
     void step_interp();
     void print(std::ostream& output);
-    void pretty_print(std::ostream& output);
     void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
 };
 
 class VarExpr : public Expr {
     public:
         std::string var;
+    static const expr_kind_t KIND = expr_kind_var;
     
     VarExpr(std::string var);
     
@@ -110,7 +155,6 @@ class VarExpr : public Expr {
     PTR(Val) interp(PTR(Env) env);
     void step_interp();
     void print(std::ostream& output);
-    void pretty_print(std::ostream& output);
     void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
 };
 
@@ -119,6 +163,7 @@ class LetExpr : public Expr {
         std::string lhs;
         PTR(Expr) rhs;
         PTR(Expr) body;
+    static const expr_kind_t KIND = expr_kind_let;
     
     LetExpr(std::string lhs, PTR(Expr) rhs, PTR(Expr) body);
     
@@ -126,7 +171,6 @@ class LetExpr : public Expr {
     PTR(Val) interp(PTR(Env) env);
     void step_interp();
     void print(std::ostream& output);
-    void pretty_print(std::ostream& output);
     void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
     
 };
@@ -135,6 +179,7 @@ class BoolExpr : public Expr{
     public:
         bool boolVal;
     PTR(Val) bVal;
+    static const expr_kind_t KIND = expr_kind_bool;
         
     BoolExpr(bool boolVal);
     
@@ -142,7 +187,6 @@ class BoolExpr : public Expr{
     PTR(Val) interp(PTR(Env) env);
     void step_interp();
     void print(std::ostream& output);
-    void pretty_print(std::ostream& output);
     void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
 };
 
@@ -150,6 +194,7 @@ class EqExpr : public Expr {
     public:
         PTR(Expr) lhs;
         PTR(Expr) rhs;
+    static const expr_kind_t KIND = expr_kind_eq;
         
     EqExpr(PTR(Expr) lhs, PTR(Expr) rhs);
     
@@ -157,7 +202,6 @@ class EqExpr : public Expr {
     PTR(Val) interp(PTR(Env) env);
     void step_interp();
     void print(std::ostream& output);
-    void pretty_print(std::ostream& output);
     void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
 };
 
@@ -166,6 +210,7 @@ class IfExpr : public Expr {
     PTR(Expr) test_part;
     PTR(Expr) then_part;
     PTR(Expr) else_part;
+    static const expr_kind_t KIND = expr_kind_if;
         
     IfExpr(PTR(Expr) _if, PTR(Expr) _then, PTR(Expr) _else);
     
@@ -173,7 +218,6 @@ class IfExpr : public Expr {
     PTR(Val) interp(PTR(Env) env);
     void step_interp();
     void print(std::ostream& output);
-    void pretty_print(std::ostream& output);
     void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
 };
 
@@ -181,6 +225,9 @@ class FunExpr : public Expr {
 public:
     std::string formal_arg;
     PTR(Expr) body;
+    //1 plus the number of _funs directly nested in body
+    int arity;
+    static const expr_kind_t KIND = expr_kind_fun;
     
     FunExpr(std::string formal_arg, PTR(Expr) body);
     
@@ -188,7 +235,6 @@ public:
     PTR(Val) interp(PTR(Env) env);
     void step_interp();
     void print(std::ostream& output);
-    void pretty_print(std::ostream& output);
     void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
 };
 
@@ -196,14 +242,37 @@ class CallExpr : public Expr {
 public:
     PTR(Expr) to_be_called;
     PTR(Expr) actual_arg;
+    //f(x)(y)(z) is a chain of 3 calls with head f
+    int chain;
+    PTR(Expr) head;
+    static const expr_kind_t KIND = expr_kind_call;
     
     CallExpr(PTR(Expr) to_be_called, PTR(Expr) actual_arg);
     
+    //argument i of the chain, counting from the head; arg(chain - 1) is actual_arg
+    PTR(Expr) arg(int i);
     bool equals(PTR(Expr) other);
     PTR(Val) interp(PTR(Env) env);
     void step_interp();
     void print(std::ostream& output);
-    void pretty_print(std::ostream& output);
+    void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
+};
+
+//_letrec binds lhs in the environment rhs is evaluated in, so a function can
+//call itself by name; the binding is filled in once rhs has a value
+class LetRecExpr : public Expr {
+public:
+    std::string lhs;
+    PTR(Expr) rhs;
+    PTR(Expr) body;
+    static const expr_kind_t KIND = expr_kind_letrec;
+    
+    LetRecExpr(std::string lhs, PTR(Expr) rhs, PTR(Expr) body);
+    
+    bool equals(PTR(Expr)other);
+    PTR(Val) interp(PTR(Env) env);
+    void step_interp();
+    void print(std::ostream& output);
     void pretty_print_at(std::ostream& output, print_mode_t mode, long *pos);
 };
 
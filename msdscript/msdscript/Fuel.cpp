@@ -0,0 +1,111 @@
+//
+//  Fuel.cpp
+//  msdscript
+//
+
+#include "Fuel.h"
+#include "Expr.h"
+#include "Val.h"
+#include "Env.h"
+#include "Cont.h"
+#include "Step.h"
+#include "Parse.h"
+#include "Program.h"
+#include "catch.h"
+
+thread_local Fuel *FuelScope::current = NULL;
+
+Fuel::Fuel(long remaining){
+    this->remaining = remaining;
+    this->used = 0;
+}
+
+OutOfFuel::OutOfFuel(long used) : std::runtime_error("out of fuel after " + std::to_string(used) + " steps") {
+    this->used = used;
+    this->resumable = false;
+    this->interp_mode = false;
+    this->expr = NULL;
+    this->env = NULL;
+    this->val = NULL;
+    this->cont = NULL;
+    this->steps = 0;
+}
+
+FuelScope::FuelScope(Fuel *fuel){
+    this->outer = current;
+    if(fuel != NULL)
+        current = fuel;
+}
+
+FuelScope::~FuelScope(){
+    current = outer;
+}
+
+void FuelScope::out_of_fuel(){
+    throw OutOfFuel(current->used);
+}
+
+TEST_CASE("Fuel"){
+    PTR(Expr) fact = parse_str("_letrec fact = _fun (n) _if n == 0 _then 1 _else n * fact(n + -1) _in fact(10)");
+    
+    //the step machine burns exactly one unit per step
+    Step::interp_by_steps(fact);
+    long steps = Step::steps;
+    {
+        Fuel enough(steps);
+        FuelScope scope(&enough);
+        CHECK(Step::interp_by_steps(fact)->to_string() == "3628800");
+        CHECK(enough.remaining == 0);
+        CHECK(enough.used == steps);
+    }
+    
+    //and running out partway can be resumed, any number of times
+    {
+        Fuel fuel(100);
+        FuelScope scope(&fuel);
+        PTR(Val) result = NULL;
+        int stops = 0;
+        try {
+            result = Step::interp_by_steps(fact);
+        } catch(OutOfFuel &stopped){
+            CHECK(stopped.resumable);
+            CHECK(stopped.used == 100);
+            CHECK(std::string(stopped.what()) == "out of fuel after 100 steps");
+            OutOfFuel at = stopped;
+            while(result == NULL){
+                stops++;
+                fuel.remaining += 100;
+                try {
+                    result = Step::resume(at);
+                } catch(OutOfFuel &again){
+                    at = again;
+                }
+            }
+        }
+        CHECK(result->to_string() == "3628800");
+        CHECK(stops == (steps + 99) / 100 - 1);
+        CHECK(fuel.used == steps);
+        CHECK(Step::steps == steps);
+    }
+    
+    //interp burns a unit per call, and can't resume
+    {
+        Fuel fuel(11);
+        FuelScope scope(&fuel);
+        CHECK(fact->interp(Env::empty)->to_string() == "3628800");
+        CHECK(fuel.remaining == 0);
+        fuel.remaining = 5;
+        try {
+            fact->interp(Env::empty);
+            CHECK(false);
+        } catch(OutOfFuel &stopped){
+            CHECK(!stopped.resumable);
+            CHECK(stopped.used == 16);
+            CHECK_THROWS_WITH(Step::resume(stopped), "cannot resume from out of fuel in interp");
+        }
+        Program calls("f(1) + f(2)");
+        fuel.remaining = 1;
+        CHECK_THROWS_AS(calls.run({{"f", parse_str("_fun (x) x")->interp(Env::empty)}}), OutOfFuel);
+    }
+    CHECK(FuelScope::current == NULL);
+}
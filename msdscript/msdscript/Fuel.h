@@ -0,0 +1,76 @@
+//
+//  Fuel.h
+//  msdscript
+//
+
+#ifndef Fuel_h
+#define Fuel_h
+
+#include <stdio.h>
+#include <stdexcept>
+#include "pointer.h"
+
+class Expr;
+class Env;
+class Val;
+class Cont;
+
+//a budget of evaluation work that comes out the same on every machine:
+//the step machine burns one unit per step_interp and step_continue, and
+//interp one per function call. Running out throws OutOfFuel
+class Fuel {
+public:
+    long remaining;
+    //burned so far, over every run and resume under this Fuel
+    long used;
+    
+    Fuel(long remaining);
+};
+
+//what running out of fuel throws. From the step machine it holds the whole
+//machine, and Step::resume carries on from it once the Fuel has more;
+//interp keeps its state on the C++ stack, so from there it can't resume
+class OutOfFuel : public std::runtime_error {
+public:
+    long used;
+    bool resumable;
+    
+    //the step machine's registers, before the step it had no fuel for
+    bool interp_mode;
+    PTR(Expr) expr;
+    PTR(Env) env;
+    PTR(Val) val;
+    PTR(Cont) cont;
+    long steps;
+    
+    OutOfFuel(long used);
+};
+
+//makes fuel the one burned on this thread until the scope ends, after
+//which the one from any enclosing scope is burned again; a NULL fuel
+//leaves the enclosing one in place
+class FuelScope {
+public:
+    static thread_local Fuel *current;
+    
+    FuelScope(Fuel *fuel);
+    ~FuelScope();
+    
+    //burns one unit for a call in interp
+    static void burn(){
+        Fuel *fuel = current;
+        if(fuel != NULL){
+            if(fuel->remaining <= 0)
+                out_of_fuel();
+            fuel->remaining--;
+            fuel->used++;
+        }
+    }
+    
+private:
+    Fuel *outer;
+    
+    static void out_of_fuel();
+};
+
+#endif /* Fuel_h */
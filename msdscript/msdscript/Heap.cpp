@@ -0,0 +1,110 @@
+//
+//  Heap.cpp
+//  msdscript
+//
+
+#include "Heap.h"
+#include "Expr.h"
+#include "Val.h"
+#include "Step.h"
+#include "Parse.h"
+#include "catch.h"
+
+thread_local Heap *HeapScope::current = NULL;
+
+Heap::Heap(long limit){
+    this->limit = limit;
+    this->live = 0;
+    this->peak = 0;
+}
+
+HeapLimitExceeded::HeapLimitExceeded(long limit, long live, long requested) : std::runtime_error("memory limit of " + std::to_string(limit) + " bytes exceeded") {
+    this->limit = limit;
+    this->live = live;
+    this->requested = requested;
+}
+
+HeapScope::HeapScope(Heap *heap){
+    this->outer = current;
+    if(heap != NULL)
+        current = heap;
+}
+
+HeapScope::~HeapScope(){
+    current = outer;
+}
+
+void HeapScope::over_limit(size_t bytes){
+    throw HeapLimitExceeded(current->limit, current->live, (long)bytes);
+}
+
+//the peak of running e with no limit
+static long peak_of(PTR(Expr) e, bool by_steps){
+    Heap heap(-1);
+    HeapScope scope(&heap);
+    if(by_steps)
+        Step::interp_by_steps(e);
+    else
+        e->interp(Env::empty);
+    return heap.peak;
+}
+
+TEST_CASE("Heap"){
+    PTR(Expr) fact = parse_str("_letrec fact = _fun (n) _if n == 0 _then 1 _else n * fact(n + -1) _in fact(10)");
+    
+    //a run fits in exactly its own peak and not a byte less, in either engine
+    for(int by_steps = 0; by_steps < 2; by_steps++){
+        long peak = peak_of(fact, by_steps);
+        CHECK(peak > 0);
+        CHECK(peak_of(fact, by_steps) == peak);
+        {
+            Heap heap(peak);
+            HeapScope scope(&heap);
+            CHECK((by_steps ? Step::interp_by_steps(fact) : fact->interp(Env::empty))->to_string() == "3628800");
+            CHECK(heap.peak == peak);
+        }
+        {
+            Heap heap(peak - 1);
+            HeapScope scope(&heap);
+            CHECK_THROWS_WITH(by_steps ? Step::interp_by_steps(fact) : fact->interp(Env::empty), "memory limit of " + std::to_string(peak - 1) + " bytes exceeded");
+            CHECK(heap.live <= peak - 1);
+            CHECK(heap.peak <= peak - 1);
+        }
+    }
+    
+    //closures built without end stop at the limit instead of taking the machine
+    PTR(Expr) hoard = parse_str("_letrec hoard = _fun (f) hoard(_fun (x) f(x) + 1) _in hoard(_fun (x) x)");
+    {
+        Heap heap(1 << 20);
+        HeapScope scope(&heap);
+        try {
+            Step::interp_by_steps(hoard);
+            FAIL("no limit");
+        } catch(HeapLimitExceeded &e){
+            CHECK(e.limit == 1 << 20);
+            CHECK(e.live + e.requested > e.limit);
+            CHECK(heap.live <= heap.limit);
+        }
+    }
+    
+    //the digits of a BigVal count along with the object
+    {
+        Heap heap(-1);
+        HeapScope scope(&heap);
+        PTR(Val) big = BigVal::parse("1" + std::string(100, '0'));
+        CHECK(big->kind == val_kind_big);
+        CHECK(heap.live >= (long)(sizeof(BigVal) + 40));
+    }
+    
+    //a NULL heap keeps the enclosing one, and nothing is charged outside a scope
+    {
+        Heap heap(-1);
+        HeapScope scope(&heap);
+        {
+            HeapScope inner(NULL);
+            fact->interp(Env::empty);
+        }
+        CHECK(heap.live > 0);
+    }
+    CHECK(HeapScope::current == NULL);
+}
@@ -0,0 +1,120 @@
+//
+//  Heap.h
+//  msdscript
+//
+
+#ifndef Heap_h
+#define Heap_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include <new>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+
+//the bytes an evaluation holds in objects made through NEW, plus the digits
+//of its BigVals. With plain pointers nothing made at run time is ever freed,
+//so live only grows; with shared_ptrs a free is taken off whichever Heap is
+//current when it happens
+class Heap {
+public:
+    //bytes live may reach, or -1 for no limit
+    long limit;
+    long live;
+    //the most live has been, for sizing limits
+    long peak;
+    
+    Heap(long limit);
+};
+
+//what going over the limit throws, before the allocation that would have
+//gone over is made
+class HeapLimitExceeded : public std::runtime_error {
+public:
+    long limit;
+    //live before the allocation, and the size asked for
+    long live;
+    long requested;
+    
+    HeapLimitExceeded(long limit, long live, long requested);
+};
+
+//makes heap the one charged on this thread until the scope ends, after
+//which the one from any enclosing scope is charged again; a NULL heap
+//leaves the enclosing one in place
+class HeapScope {
+public:
+    static thread_local Heap *current;
+    
+    HeapScope(Heap *heap);
+    ~HeapScope();
+    
+    static void charge(size_t bytes){
+        Heap *heap = current;
+        if(heap != NULL){
+            if(heap->limit >= 0 && heap->live + (long)bytes > heap->limit)
+                over_limit(bytes);
+            heap->live += bytes;
+            if(heap->live > heap->peak)
+                heap->peak = heap->live;
+        }
+    }
+    static void credit(size_t bytes){
+        Heap *heap = current;
+        if(heap != NULL)
+            heap->live -= bytes;
+    }
+
+private:
+    Heap *outer;
+    
+    static void over_limit(size_t bytes);
+};
+
+//NEW with plain pointers is new (HeapCharged()) T, so each object is
+//charged as it is made
+struct HeapCharged {};
+
+inline void *operator new(size_t size, HeapCharged){
+    HeapScope::charge(size);
+    return ::operator new(size);
+}
+
+//only called when a constructor throws
+inline void operator delete(void *p, HeapCharged){
+    ::operator delete(p);
+}
+
+//NEW with shared_ptrs allocates through this, which charges the object
+//and its control block together and credits them when they are freed
+template <class T>
+class HeapAllocator {
+public:
+    typedef T value_type;
+    
+    HeapAllocator() {}
+    template <class U>
+    HeapAllocator(const HeapAllocator<U> &) {}
+    
+    T *allocate(size_t n){
+        HeapScope::charge(n * sizeof(T));
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T *p, size_t n){
+        HeapScope::credit(n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template <class T, class U>
+inline bool operator==(const HeapAllocator<T> &, const HeapAllocator<U> &) { return true; }
+template <class T, class U>
+inline bool operator!=(const HeapAllocator<T> &, const HeapAllocator<U> &) { return false; }
+
+template <class T, class... Args>
+inline std::shared_ptr<T> heap_make_shared(Args&&... args){
+    return std::allocate_shared<T>(HeapAllocator<T>(), std::forward<Args>(args)...);
+}
+
+#endif /* Heap_h */
@@ -0,0 +1,216 @@
+//
+//  Memo.cpp
+//  msdscript
+//
+
+#include "Memo.h"
+#include "Val.h"
+#include "Expr.h"
+#include "Step.h"
+#include "Stats.h"
+#include "catch.h"
+#include <list>
+#include <unordered_map>
+#include <sstream>
+
+bool Memo::enabled = false;
+long Memo::capacity = 1 << 16;
+long Memo::hits;
+long Memo::misses;
+long Memo::evictions;
+
+struct MemoKey {
+    PTR(Val) fun;
+    int count;
+    PTR(Val) args[Memo::MAX_ARGS];
+    size_t hash;
+};
+
+struct MemoEntry {
+    MemoKey key;
+    PTR(Val) result;
+};
+
+//most recently used first; list nodes stay put, so the table can point
+//at the keys inside them
+typedef std::list<MemoEntry> MemoList;
+
+//the same recipe as boost::hash_combine
+static size_t mix(size_t seed, size_t v){
+    return seed ^ (v + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+static size_t arg_hash(PTR(Val) v){
+    PTR(NumVal) n = KIND_CAST(NumVal)(v);
+    if(n != NULL)
+        return std::hash<int64_t>()(n->val);
+    PTR(BoolVal) b = KIND_CAST(BoolVal)(v);
+    if(b != NULL)
+        return b->boolVal ? 1 : 0;
+    PTR(BigVal) big = KIND_CAST(BigVal)(v);
+    if(big != NULL){
+        size_t h = big->negative;
+        for(uint32_t d : big->digits)
+            h = mix(h, d);
+        return h;
+    }
+    return std::hash<const void *>()(&*v);
+}
+
+static bool same_arg(PTR(Val) a, PTR(Val) b){
+    if(a->kind != b->kind)
+        return false;
+    if(a->kind == val_kind_num)
+        return KIND_CAST(NumVal)(a)->val == KIND_CAST(NumVal)(b)->val;
+    if(a->kind == val_kind_bool)
+        return KIND_CAST(BoolVal)(a)->boolVal == KIND_CAST(BoolVal)(b)->boolVal;
+    if(a->kind == val_kind_big)
+        return a->equals(b);
+    return &*a == &*b;
+}
+
+struct KeyHash {
+    size_t operator()(const MemoKey *k) const {
+        return k->hash;
+    }
+};
+
+struct KeyEqual {
+    bool operator()(const MemoKey *a, const MemoKey *b) const {
+        if(a->hash != b->hash || &*a->fun != &*b->fun || a->count != b->count)
+            return false;
+        for(int i = 0; i < a->count; i++){
+            if(!same_arg(a->args[i], b->args[i]))
+                return false;
+        }
+        return true;
+    }
+};
+
+static MemoList recent;
+static std::unordered_map<const MemoKey *, MemoList::iterator, KeyHash, KeyEqual> table;
+
+//the key holds on to fun and args, so an identity in it can't be reused
+//by some other value while the entry lives
+static void make_key(MemoKey &key, PTR(Val) fun, PTR(Val) *args, int count){
+    key.fun = fun;
+    key.count = count;
+    key.hash = mix(std::hash<const void *>()(&*fun), count);
+    for(int i = 0; i < count; i++){
+        key.args[i] = args[i];
+        key.hash = mix(key.hash, arg_hash(args[i]));
+    }
+}
+
+PTR(Val) Memo::find(PTR(Val) fun, PTR(Val) *args, int count){
+    MemoKey probe;
+    make_key(probe, fun, args, count);
+    auto found = table.find(&probe);
+    if(found == table.end()){
+        misses++;
+        return NULL;
+    }
+    hits++;
+    recent.splice(recent.begin(), recent, found->second);
+    return found->second->result;
+}
+
+void Memo::store(PTR(Val) fun, PTR(Val) *args, int count, PTR(Val) result){
+    if(capacity <= 0)
+        return;
+    MemoEntry entry;
+    make_key(entry.key, fun, args, count);
+    entry.result = result;
+    auto found = table.find(&entry.key);
+    if(found != table.end()){
+        found->second->result = result;
+        recent.splice(recent.begin(), recent, found->second);
+        return;
+    }
+    recent.push_front(entry);
+    table[&recent.front().key] = recent.begin();
+    if((long)table.size() > capacity){
+        table.erase(&recent.back().key);
+        recent.pop_back();
+        evictions++;
+    }
+}
+
+long Memo::size(){
+    return (long)table.size();
+}
+
+void Memo::clear(){
+    table.clear();
+    recent.clear();
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
+
+void Memo::print(std::ostream &out){
+    out << "memo: " << hits << " hits, " << misses << " misses, "
+        << evictions << " evictions, " << size() << " entries\n";
+}
+
+TEST_CASE("Memo"){
+    std::string fib = "_letrec fib = _fun (n) _if n == 0 _then 0 _else _if n == 1 _then 1 "
+                      "_else fib(n + -1) + fib(n + -2) _in fib(25)";
+    PTR(Expr) e = parse_str(fib);
+    
+    //each n from 0 to 25 misses once, and the second call of every fib(n) past
+    //fib(2) finds its result
+    Memo::clear();
+    Memo::enabled = true;
+    CHECK(e->interp(Env::empty)->equals(NEW(NumVal)(75025)));
+    CHECK(Memo::misses == 26);
+    CHECK(Memo::hits == 23);
+    CHECK(Memo::size() == 26);
+    Memo::clear();
+    CHECK(Step::interp_by_steps(e)->equals(NEW(NumVal)(75025)));
+    CHECK(Memo::misses == 26);
+    CHECK(Memo::hits == 23);
+    
+    //the bodies run once per argument instead of fib(25) times
+    Memo::clear();
+    Stats::reset();
+    Stats::enabled = true;
+    Step::interp_by_steps(e);
+    Stats::enabled = false;
+    CHECK(Stats::step_continues[cont_kind_memo_store] == 26);
+    CHECK(Stats::step_interps[expr_kind_if] < 60);
+    
+    //chains bound in one frame key on every argument
+    Memo::clear();
+    PTR(Expr) self_applied = parse_str("_let fib = _fun (f) _fun (n) _if n == 0 _then 0 _else _if n == 1 _then 1 "
+                                       "_else f(f)(n + -1) + f(f)(n + -2) _in fib(fib)(25)");
+    CHECK(self_applied->interp(Env::empty)->equals(NEW(NumVal)(75025)));
+    CHECK(Memo::misses == 26);
+    Memo::clear();
+    CHECK(Step::interp_by_steps(self_applied)->equals(NEW(NumVal)(75025)));
+    CHECK(Memo::misses == 26);
+    
+    //functions key by identity, so the two closures don't share results
+    Memo::clear();
+    CHECK(parse_str("_let apply = _fun (g) g(1) _in apply(_fun (x) x + 1) + apply(_fun (x) x + 2)")->interp(Env::empty)->equals(NEW(NumVal)(5)));
+    CHECK(Memo::hits == 0);
+    CHECK(parse_str("(_fun (x) x == 1)(1 == 1)")->interp(Env::empty)->equals(NEW(BoolVal)(false)));
+    
+    //least recently used results go first
+    Memo::clear();
+    Memo::capacity = 2;
+    CHECK(parse_str("_let f = _fun (x) x * x _in f(1) + f(2) + f(1) + f(3) + f(1) + f(2)")->interp(Env::empty)->equals(NEW(NumVal)(20)));
+    CHECK(Memo::hits == 2);
+    CHECK(Memo::misses == 4);
+    CHECK(Memo::evictions == 2);
+    CHECK(Memo::size() == 2);
+    std::stringstream out;
+    Memo::print(out);
+    CHECK(out.str() == "memo: 2 hits, 4 misses, 2 evictions, 2 entries\n");
+    Memo::capacity = 1 << 16;
+    
+    Memo::enabled = false;
+    Memo::clear();
+    e->interp(Env::empty);
+    CHECK(Memo::misses == 0);
+}
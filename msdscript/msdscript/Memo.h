@@ -0,0 +1,42 @@
+//
+//  Memo.h
+//  msdscript
+//
+
+#ifndef Memo_h
+#define Memo_h
+
+#include <stdio.h>
+#include <ostream>
+#include "pointer.h"
+#include "Env.h"
+
+class Val;
+
+//memo table for --memo; with no mutation in the language, a function called
+//on the same arguments always gives the same value, so while enabled every
+//FunVal call looks in a table keyed by the closure and its arguments first.
+//Numbers and booleans key by value, functions by identity. At most capacity
+//results are kept, evicting the least recently used
+class Memo {
+public:
+    static const int MAX_ARGS = FrameEnv::MAX_SLOTS;
+    
+    static bool enabled;
+    static long capacity;
+    
+    static long hits;
+    static long misses;
+    static long evictions;
+    
+    //the value fun gave for these args, or NULL if there is none yet
+    static PTR(Val) find(PTR(Val) fun, PTR(Val) *args, int count);
+    static void store(PTR(Val) fun, PTR(Val) *args, int count, PTR(Val) result);
+    
+    static long size();
+    //drops every result and zeroes the counts
+    static void clear();
+    static void print(std::ostream &out);
+};
+
+#endif /* Memo_h */
@@ -0,0 +1,654 @@
+//
+//  Msdb.cpp
+//  msdscript
+//
+
+#include "Msdb.h"
+#include "Expr.h"
+#include "Env.h"
+#include "Native.h"
+#include "Stats.h"
+#include "Cancel.h"
+#include "Fuel.h"
+#include "catch.h"
+#include <stdexcept>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+MsdbEnv::MsdbEnv(int32_t name, PTR(Val) val, PTR(MsdbEnv) rest){
+    this->name = name;
+    this->val = val;
+    this->rest = rest;
+}
+
+//builds the node and name sections; nodes are appended children first,
+//so every child offset is negative
+class MsdbWriter {
+public:
+    std::string nodes;
+    std::vector<std::string> names;
+    std::map<std::string, int32_t> name_ids;
+    uint32_t literals = 0;
+    
+    int32_t name(std::string s){
+        auto found = name_ids.find(s);
+        if(found != name_ids.end())
+            return found->second;
+        names.push_back(s);
+        return name_ids[s] = (int32_t)names.size() - 1;
+    }
+    
+    //offset of the node from the start of the file
+    uint32_t emit(PTR(Expr) e){
+        MsdbNode node = {(uint32_t)e->kind, 0, 0, 0};
+        //absolute offsets of the children in fields a, b and c; 0 for none
+        uint32_t children[3] = {0, 0, 0};
+        switch(e->kind){
+            case expr_kind_num: {
+                PTR(NumExpr) num = KIND_CAST(NumExpr)(e);
+                if(num->numVal->kind == val_kind_num && num->val >= INT32_MIN && num->val <= INT32_MAX)
+                    node.a = (int32_t)num->val;
+                else {
+                    node.a = name(num->numVal->to_string());
+                    node.c = 1;
+                }
+                node.b = literals++;
+                break;
+            }
+            case expr_kind_bool:
+                node.a = KIND_CAST(BoolExpr)(e)->boolVal;
+                node.b = literals++;
+                break;
+            case expr_kind_var:
+                node.a = name(KIND_CAST(VarExpr)(e)->var);
+                break;
+            case expr_kind_add:
+                children[0] = emit(KIND_CAST(AddExpr)(e)->lhs);
+                children[1] = emit(KIND_CAST(AddExpr)(e)->rhs);
+                break;
+            case expr_kind_mult:
+                children[0] = emit(KIND_CAST(MultExpr)(e)->lhs);
+                children[1] = emit(KIND_CAST(MultExpr)(e)->rhs);
+                break;
+            case expr_kind_eq:
+                children[0] = emit(KIND_CAST(EqExpr)(e)->lhs);
+                children[1] = emit(KIND_CAST(EqExpr)(e)->rhs);
+                break;
+            case expr_kind_call:
+                children[0] = emit(KIND_CAST(CallExpr)(e)->to_be_called);
+                children[1] = emit(KIND_CAST(CallExpr)(e)->actual_arg);
+                break;
+            case expr_kind_if:
+                children[0] = emit(KIND_CAST(IfExpr)(e)->test_part);
+                children[1] = emit(KIND_CAST(IfExpr)(e)->then_part);
+                children[2] = emit(KIND_CAST(IfExpr)(e)->else_part);
+                break;
+            case expr_kind_let: {
+                PTR(LetExpr) let = KIND_CAST(LetExpr)(e);
+                node.a = name(let->lhs);
+                children[1] = emit(let->rhs);
+                children[2] = emit(let->body);
+                break;
+            }
+            case expr_kind_letrec: {
+                PTR(LetRecExpr) let = KIND_CAST(LetRecExpr)(e);
+                node.a = name(let->lhs);
+                children[1] = emit(let->rhs);
+                children[2] = emit(let->body);
+                break;
+            }
+            case expr_kind_fun: {
+                PTR(FunExpr) fun = KIND_CAST(FunExpr)(e);
+                node.a = name(fun->formal_arg);
+                children[1] = emit(fun->body);
+                break;
+            }
+        }
+        uint32_t at = (uint32_t)(sizeof(MsdbHeader) + nodes.size());
+        int32_t *fields[3] = {&node.a, &node.b, &node.c};
+        for(int i = 0; i < 3; i++){
+            if(children[i] != 0)
+                *fields[i] = (int32_t)children[i] - (int32_t)at;
+        }
+        nodes.append((const char *)&node, sizeof(node));
+        return at;
+    }
+};
+
+static void append_u32(std::string &out, uint32_t v){
+    out.append((const char *)&v, sizeof(v));
+}
+
+//64-bit FNV-1a
+static uint64_t fnv1a(uint64_t hash, const std::string &s){
+    for(size_t i = 0; i < s.size(); i++){
+        hash ^= (unsigned char)s[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t MsdbImage::source_hash(std::string source){
+    return fnv1a(14695981039346656037ULL, source);
+}
+
+//the path of the running program, or "" where it can't be found
+static std::string executable_path(){
+#ifdef __APPLE__
+    char path[4096];
+    uint32_t size = sizeof(path);
+    if(_NSGetExecutablePath(path, &size) == 0)
+        return path;
+    return "";
+#else
+    return "/proc/self/exe";
+#endif
+}
+
+//every link writes the program anew, so its size and modification time
+//change with any rebuild, whichever build system did it; the format
+//version and pointer mode go in as well. Only if the program can't be
+//found does this file's own compile time stand in
+uint64_t MsdbImage::build_id(){
+    static uint64_t id = 0;
+    if(id == 0){
+        std::string build = std::to_string(VERSION) + " " + std::to_string(sizeof(PTR(Val))) + " ";
+        struct stat st;
+        if(stat(executable_path().c_str(), &st) == 0){
+#ifdef __APPLE__
+            long nanos = st.st_mtimespec.tv_nsec;
+#else
+            long nanos = st.st_mtim.tv_nsec;
+#endif
+            build += std::to_string((long long)st.st_size) + " " + std::to_string((long long)st.st_mtime) + "." + std::to_string(nanos);
+        }else
+            build += __DATE__ " " __TIME__;
+        id = fnv1a(14695981039346656037ULL, build);
+    }
+    return id;
+}
+
+void MsdbImage::write(PTR(Expr) e, std::string source, std::ostream &out){
+    MsdbWriter writer;
+    uint32_t root = writer.emit(e);
+    
+    uint32_t names_at = (uint32_t)(sizeof(MsdbHeader) + writer.nodes.size());
+    std::string names;
+    append_u32(names, (uint32_t)writer.names.size());
+    uint32_t text_at = names_at + 4 * (uint32_t)(writer.names.size() + 1);
+    std::string text;
+    for(std::string &s : writer.names){
+        append_u32(names, text_at + (uint32_t)text.size());
+        append_u32(text, (uint32_t)s.size());
+        text += s;
+        text.append((4 - s.size() % 4) % 4, '\0');
+    }
+    
+    MsdbHeader header;
+    memcpy(header.magic, "MSDB", 4);
+    header.version = VERSION;
+    header.source = text_at + (uint32_t)text.size();
+    header.source_size = (uint32_t)source.size();
+    header.size = header.source + header.source_size;
+    header.root = root;
+    header.names = names_at;
+    header.literals = writer.literals;
+    header.source_hash = source_hash(source);
+    header.build = build_id();
+    out.write((const char *)&header, sizeof(header));
+    out << writer.nodes << names << text << source;
+}
+
+MsdbImage::MsdbImage(const char *bytes, size_t size){
+    this->bytes = bytes;
+    this->size = size;
+    this->header = (const MsdbHeader *)bytes;
+    this->globals = Natives::env();
+}
+
+MsdbImage::~MsdbImage(){
+    munmap((void *)bytes, size);
+}
+
+MsdbImage *MsdbImage::load(std::string path){
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("cannot open " + path);
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MsdbHeader)){
+        close(fd);
+        throw std::runtime_error("not an msdb file: " + path);
+    }
+    void *mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        throw std::runtime_error("cannot map " + path);
+    MsdbImage *image = new MsdbImage((const char *)mapped, (size_t)st.st_size);
+    try{
+        image->check(path);
+    }catch(std::runtime_error &){
+        delete image;
+        throw;
+    }
+    return image;
+}
+
+static uint32_t read_u32(const char *p){
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+//one pass over every node and name, so interp and name can trust offsets
+void MsdbImage::check(std::string path){
+    if(memcmp(header->magic, "MSDB", 4) != 0 || header->version != VERSION)
+        throw std::runtime_error("not an msdb file: " + path);
+    std::runtime_error corrupt("corrupt msdb file: " + path);
+    uint32_t first = sizeof(MsdbHeader);
+    uint32_t end = header->names;
+    if(header->size != size || end > size - 4 || end < first + sizeof(MsdbNode) || (end - first) % sizeof(MsdbNode) != 0)
+        throw corrupt;
+    if(header->root < first || header->root >= end || (header->root - first) % sizeof(MsdbNode) != 0)
+        throw corrupt;
+    if(header->source < end || header->source > size || header->source_size != size - header->source)
+        throw corrupt;
+    
+    uint32_t name_count = read_u32(bytes + end);
+    if(name_count > (size - end - 4) / 4)
+        throw corrupt;
+    for(uint32_t i = 0; i < name_count; i++){
+        uint32_t at = read_u32(bytes + end + 4 + 4 * i);
+        if(at < end || at > size - 4 || read_u32(bytes + at) > size - at - 4)
+            throw corrupt;
+    }
+    
+    //every literal is a node, so a larger count can only be a bad header
+    if(header->literals > (end - first) / sizeof(MsdbNode))
+        throw corrupt;
+    literals.assign(header->literals, NULL);
+    for(uint32_t at = first; at < end; at += sizeof(MsdbNode)){
+        const MsdbNode *node = (const MsdbNode *)(bytes + at);
+        int children = 0;
+        int32_t offsets[3] = {0, 0, 0};
+        switch(node->kind){
+            case expr_kind_num:
+            case expr_kind_bool:
+                if(node->b < 0 || (uint32_t)node->b >= header->literals || literals[node->b] != NULL)
+                    throw corrupt;
+                if(node->kind == expr_kind_num && node->c == 1){
+                    if(node->a < 0 || (uint32_t)node->a >= name_count)
+                        throw corrupt;
+                    std::string digits = name(node->a);
+                    if(digits.find_first_not_of("0123456789", digits[0] == '-') != std::string::npos || digits.size() < 2)
+                        throw corrupt;
+                    literals[node->b] = BigVal::parse(digits);
+                }
+                else if(node->kind == expr_kind_num)
+                    literals[node->b] = NEW(NumVal)(node->a);
+                else
+                    literals[node->b] = NEW(BoolVal)(node->a != 0);
+                break;
+            case expr_kind_var:
+                if(node->a < 0 || (uint32_t)node->a >= name_count)
+                    throw corrupt;
+                break;
+            case expr_kind_add:
+            case expr_kind_mult:
+            case expr_kind_eq:
+            case expr_kind_call:
+                offsets[0] = node->a;
+                offsets[1] = node->b;
+                children = 2;
+                break;
+            case expr_kind_if:
+                offsets[0] = node->a;
+                offsets[1] = node->b;
+                offsets[2] = node->c;
+                children = 3;
+                break;
+            case expr_kind_let:
+            case expr_kind_letrec:
+            case expr_kind_fun:
+                if(node->a < 0 || (uint32_t)node->a >= name_count)
+                    throw corrupt;
+                offsets[0] = node->b;
+                offsets[1] = node->c;
+                children = (node->kind == expr_kind_fun) ? 1 : 2;
+                break;
+            default:
+                throw corrupt;
+        }
+        //children come first, which also rules out cycles
+        for(int i = 0; i < children; i++){
+            int64_t child_at = (int64_t)at + offsets[i];
+            if(offsets[i] >= 0 || child_at < first || (child_at - first) % sizeof(MsdbNode) != 0)
+                throw corrupt;
+        }
+    }
+    for(PTR(Val) literal : literals){
+        if(literal == NULL)
+            throw corrupt;
+    }
+}
+
+MsdbImage *MsdbImage::cached(std::string dir, std::string source, bool *hit){
+    uint64_t hash = source_hash(source);
+    char name[40];
+    snprintf(name, sizeof(name), "/msd-a-%016llx.msdb", (unsigned long long)hash);
+    std::string path = dir + name;
+    if(access(path.c_str(), R_OK) == 0){
+        try{
+            MsdbImage *image = load(path);
+            //the hash only names the file; two programs can share one
+            if(image->header->build == build_id() && image->source() == source){
+                if(hit != NULL)
+                    *hit = true;
+                return image;
+            }
+            delete image;
+        }catch(std::runtime_error &){
+            //an unreadable image is replaced like a missing one
+        }
+    }
+    if(hit != NULL)
+        *hit = false;
+    
+    PTR(Expr) e = parse_str(source);
+    if(mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+        return NULL;
+    //written under another name and renamed, so no run maps half a file
+    std::string temp = path + ".tmp-" + std::to_string((long)getpid());
+    std::ofstream out(temp, std::ios::binary);
+    write(e, source, out);
+    out.close();
+    if(!out || rename(temp.c_str(), path.c_str()) != 0){
+        unlink(temp.c_str());
+        return NULL;
+    }
+    return load(path);
+}
+
+const MsdbNode *MsdbImage::root(){
+    return (const MsdbNode *)(bytes + header->root);
+}
+
+const MsdbNode *MsdbImage::child(const MsdbNode *node, int32_t offset){
+    return (const MsdbNode *)((const char *)node + offset);
+}
+
+std::string MsdbImage::name(int32_t id){
+    const char *entry = bytes + read_u32(bytes + header->names + 4 + 4 * id);
+    return std::string(entry + 4, read_u32(entry));
+}
+
+std::string MsdbImage::source(){
+    return std::string(bytes + header->source, header->source_size);
+}
+
+PTR(Val) MsdbImage::run(){
+    return interp(root(), NULL);
+}
+
+PTR(Val) MsdbImage::lookup(int32_t id, PTR(MsdbEnv) env){
+    for(PTR(MsdbEnv) e = env; e != NULL; e = e->rest){
+        if(e->name == id){
+            if(e->val == NULL)
+                throw std::runtime_error("_letrec variable used before it has a value: " + name(id));
+            return e->val;
+        }
+    }
+    return globals->lookup(name(id));
+}
+
+PTR(Val) MsdbImage::interp(const MsdbNode *node, PTR(MsdbEnv) env){
+    switch(node->kind){
+        case expr_kind_num:
+        case expr_kind_bool:
+            return literals[node->b];
+        case expr_kind_add:
+            return interp(child(node, node->a), env)->add_to(interp(child(node, node->b), env));
+        case expr_kind_mult:
+            return interp(child(node, node->a), env)->mult_to(interp(child(node, node->b), env));
+        case expr_kind_eq:
+            return NEW(BoolVal)(interp(child(node, node->a), env)->equals(interp(child(node, node->b), env)));
+        case expr_kind_var:
+            return lookup(node->a, env);
+        case expr_kind_if:
+            if(interp(child(node, node->a), env)->is_true())
+                return interp(child(node, node->b), env);
+            return interp(child(node, node->c), env);
+        case expr_kind_let: {
+            PTR(Val) rhs = interp(child(node, node->b), env);
+            return interp(child(node, node->c), NEW(MsdbEnv)(node->a, rhs, env));
+        }
+        case expr_kind_letrec: {
+            PTR(MsdbEnv) new_env = NEW(MsdbEnv)(node->a, nullptr, env);
+            new_env->val = interp(child(node, node->b), new_env);
+            return interp(child(node, node->c), new_env);
+        }
+        case expr_kind_fun:
+            return NEW(MsdbFunVal)(this, node, env);
+        default: {
+            PTR(Val) f = interp(child(node, node->a), env);
+            return f->call(interp(child(node, node->b), env));
+        }
+    }
+}
+
+PTR(Expr) MsdbImage::to_expr(const MsdbNode *node){
+    switch(node->kind){
+        case expr_kind_num:
+            if(node->c == 1)
+                return NumExpr::literal(name(node->a));
+            return NEW(NumExpr)(node->a);
+        case expr_kind_bool:
+            return NEW(BoolExpr)(node->a != 0);
+        case expr_kind_var:
+            return NEW(VarExpr)(name(node->a));
+        case expr_kind_add:
+            return NEW(AddExpr)(to_expr(child(node, node->a)), to_expr(child(node, node->b)));
+        case expr_kind_mult:
+            return NEW(MultExpr)(to_expr(child(node, node->a)), to_expr(child(node, node->b)));
+        case expr_kind_eq:
+            return NEW(EqExpr)(to_expr(child(node, node->a)), to_expr(child(node, node->b)));
+        case expr_kind_if:
+            return NEW(IfExpr)(to_expr(child(node, node->a)), to_expr(child(node, node->b)), to_expr(child(node, node->c)));
+        case expr_kind_let:
+            return NEW(LetExpr)(name(node->a), to_expr(child(node, node->b)), to_expr(child(node, node->c)));
+        case expr_kind_letrec:
+            return NEW(LetRecExpr)(name(node->a), to_expr(child(node, node->b)), to_expr(child(node, node->c)));
+        case expr_kind_fun:
+            return NEW(FunExpr)(name(node->a), to_expr(child(node, node->b)));
+        default:
+            return NEW(CallExpr)(to_expr(child(node, node->a)), to_expr(child(node, node->b)));
+    }
+}
+
+MsdbFunVal::MsdbFunVal(MsdbImage *image, const MsdbNode *fun, PTR(MsdbEnv) env){
+    this->kind = KIND;
+    if(Stats::enabled)
+        Stats::vals[KIND]++;
+    this->image = image;
+    this->fun = fun;
+    this->env = env;
+}
+
+bool MsdbFunVal::equals(PTR(Val) other){
+    PTR(MsdbFunVal) f = KIND_CAST(MsdbFunVal)(other);
+    return f != NULL && f->image == image && f->fun == fun;
+}
+
+PTR(Val) MsdbFunVal::add_to(PTR(Val) rhs){
+    throw std::runtime_error("addition of non-number");
+}
+
+PTR(Val) MsdbFunVal::mult_to(PTR(Val) rhs){
+    throw std::runtime_error("multiplication of non-number");
+}
+
+void MsdbFunVal::print(std::ostream& output){
+    image->to_expr(fun)->print(output);
+}
+
+bool MsdbFunVal::is_true(){
+    throw std::runtime_error("Test expression is not a boolean");
+}
+
+PTR(Val) MsdbFunVal::call(PTR(Val) actual_arg){
+    CancelScope::check();
+    FuelScope::burn();
+    return image->interp(image->child(fun, fun->b), NEW(MsdbEnv)(fun->a, actual_arg, env));
+}
+
+void MsdbFunVal::call_step(PTR(Val) actual_arg_val, PTR(Cont) rest){
+    throw std::runtime_error("compiled functions only run under --run-ast");
+}
+
+//writes e to a temporary file and loads it back
+static MsdbImage *compile(PTR(Expr) e, std::string path){
+    std::ofstream out(path, std::ios::binary);
+    MsdbImage::write(e, e->to_string(), out);
+    out.close();
+    return MsdbImage::load(path);
+}
+
+static void write_bytes(std::string path, std::string contents){
+    std::ofstream(path, std::ios::binary) << contents;
+}
+
+TEST_CASE("Msdb"){
+    char path_template[] = "/tmp/msdbXXXXXX";
+    int fd = mkstemp(path_template);
+    close(fd);
+    std::string path = path_template;
+    
+    std::string programs[] = {
+        "_let x = 5 _in _let y = x * 2 _in y + x",
+        "_if 1 == 2 _then _false _else (_true == _true)",
+        "_let f = _fun (x) _fun (y) x * 10 + y _in f(4)(2)",
+        "_letrec fact = _fun (n) _if n == 0 _then 1 _else n * fact(n + -1) _in fact(10)",
+        "_let fib = _fun (fib) _fun (n) _if n == 0 _then 0 _else _if n == 1 _then 1 "
+            "_else fib(fib)(n + -1) + fib(fib)(n + -2) _in fib(fib)(15)",
+        "_let x = 1 _in _let x = x + 1 _in x",
+        "max(3)(abs(-9))",
+        "_fun (x) x + -1",
+        "3000000000 * -2147483649 + 123456789012345678901234567890",
+    };
+    for(std::string program : programs){
+        PTR(Expr) e = parse_str(program);
+        MsdbImage *image = compile(e, path);
+        CHECK(image->to_expr(image->root())->equals(e));
+        CHECK(image->run()->to_string() == e->interp(Natives::env())->to_string());
+        delete image;
+    }
+    
+    MsdbImage *image = compile(parse_str("_let y = 2 _in _fun (x) x + y"), path);
+    PTR(Val) f = image->run();
+    CHECK(f->call(NEW(NumVal)(40))->to_string() == "42");
+    CHECK(f->equals(image->run()));
+    CHECK(!f->equals(parse_str("_fun (x) x + y")->interp(Env::empty)));
+    CHECK_THROWS_WITH(f->call_step(NEW(NumVal)(1), NULL), "compiled functions only run under --run-ast");
+    delete image;
+    image = compile(parse_str("_letrec x = x _in x"), path);
+    CHECK_THROWS_WITH(image->run(), "_letrec variable used before it has a value: x");
+    delete image;
+    image = compile(parse_str("y + 1"), path);
+    CHECK_THROWS_WITH(image->run(), "free variable: y");
+    delete image;
+    
+    //files that are cut short, from elsewhere, or point outside themselves
+    std::ostringstream good;
+    MsdbImage::write(parse_str("_let x = 1 _in x + 2"), "_let x = 1 _in x + 2", good);
+    std::string bytes = good.str();
+    write_bytes(path, bytes.substr(0, bytes.size() - 4));
+    CHECK_THROWS_WITH(MsdbImage::load(path), "corrupt msdb file: " + path);
+    write_bytes(path, "MSDX" + bytes.substr(4));
+    CHECK_THROWS_WITH(MsdbImage::load(path), "not an msdb file: " + path);
+    write_bytes(path, "MSDB");
+    CHECK_THROWS_WITH(MsdbImage::load(path), "not an msdb file: " + path);
+    std::string forward = bytes;
+    MsdbNode root;
+    uint32_t root_at = ((const MsdbHeader *)bytes.data())->root;
+    memcpy(&root, &bytes[root_at], sizeof(root));
+    root.c = 16;
+    memcpy(&forward[root_at], &root, sizeof(root));
+    write_bytes(path, forward);
+    CHECK_THROWS_WITH(MsdbImage::load(path), "corrupt msdb file: " + path);
+    std::string counted = bytes;
+    ((MsdbHeader *)&counted[0])->literals = 0xffffffff;
+    write_bytes(path, counted);
+    CHECK_THROWS_WITH(MsdbImage::load(path), "corrupt msdb file: " + path);
+    unlink(path.c_str());
+    CHECK_THROWS_WITH(MsdbImage::load(path), "cannot open " + path);
+}
+
+TEST_CASE("Msdb Cache"){
+    char dir_template[] = "/tmp/msdbcacheXXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    std::string source = "_letrec fact = _fun (n) _if n == 0 _then 1 _else n * fact(n + -1) _in fact(6)";
+    
+    bool hit = true;
+    MsdbImage *image = MsdbImage::cached(dir, source, &hit);
+    CHECK(!hit);
+    CHECK(image->run()->to_string() == "720");
+    CHECK(image->header->source_hash == MsdbImage::source_hash(source));
+    CHECK(image->header->build == MsdbImage::build_id());
+    delete image;
+    image = MsdbImage::cached(dir, source, &hit);
+    CHECK(hit);
+    CHECK(image->run()->to_string() == "720");
+    delete image;
+    image = MsdbImage::cached(dir, source + " + 1", &hit);
+    CHECK(!hit);
+    CHECK(image->run()->to_string() == "721");
+    delete image;
+    
+    //an image from another build is compiled again
+    char name[40];
+    snprintf(name, sizeof(name), "/msd-a-%016llx.msdb", (unsigned long long)MsdbImage::source_hash(source));
+    std::string path = dir + name;
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    MsdbHeader header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    header.build++;
+    memcpy(&bytes[0], &header, sizeof(header));
+    write_bytes(path, bytes);
+    image = MsdbImage::cached(dir, source, &hit);
+    CHECK(!hit);
+    delete image;
+    image = MsdbImage::cached(dir, source, &hit);
+    CHECK(hit);
+    delete image;
+    
+    //an image under the right name but of another program is a miss, as when
+    //two programs' hashes collide
+    char other[40];
+    snprintf(other, sizeof(other), "/msd-a-%016llx.msdb", (unsigned long long)MsdbImage::source_hash(source + " + 1"));
+    CHECK(rename(path.c_str(), (dir + other).c_str()) == 0);
+    image = MsdbImage::cached(dir, source + " + 1", &hit);
+    CHECK(!hit);
+    CHECK(image->source() == source + " + 1");
+    CHECK(image->run()->to_string() == "721");
+    delete image;
+    image = MsdbImage::cached(dir, source + " + 1", &hit);
+    CHECK(hit);
+    delete image;
+    
+    CHECK_THROWS_WITH(MsdbImage::cached(dir, "1 +"), "invalid input");
+    CHECK(MsdbImage::cached("/dev/null/cache", "1") == NULL);
+    
+    unlink((dir + other).c_str());
+    CHECK(rmdir(dir.c_str()) == 0);
+}
@@ -0,0 +1,135 @@
+//
+//  Msdb.h
+//  msdscript
+//
+
+#ifndef Msdb_h
+#define Msdb_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "pointer.h"
+#include "Val.h"
+
+class Expr;
+class Env;
+
+//compiled program file for --compile-ast and --run-ast. Every expression is
+//one fixed-size node, and nodes refer to their children by byte offsets
+//relative to themselves, so a mapped file is run where it lies without
+//building any Exprs. Variable names are numbered once in a name table and
+//matched by number while running
+//
+//  header  "MSDB", version, size, root, names, literals, source, source
+//          size, source hash, build
+//  nodes   MsdbNode for each expression, children before parents
+//  names   count, then the offset of each name; at each offset a
+//          uint32_t length and the characters, padded to 4 bytes
+//  source  the program text the file was compiled from
+struct MsdbHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;
+    uint32_t root;
+    uint32_t names;
+    //NumExprs and BoolExprs, each numbered in its a or b field
+    uint32_t literals;
+    //what the file was compiled from, and by which build of msdscript
+    uint32_t source;
+    uint32_t source_size;
+    uint64_t source_hash;
+    uint64_t build;
+};
+
+//a, b and c per kind:
+//  num       value, literal number, 0; or for a number outside int32_t,
+//            name of its decimal digits, literal number, 1
+//  bool      value, literal number
+//  var       name
+//  add/mult/eq/call   lhs or callee, rhs or argument
+//  if        test, then, else
+//  let/letrec  name, rhs, body
+//  fun       name, body
+struct MsdbNode {
+    uint32_t kind;
+    int32_t a;
+    int32_t b;
+    int32_t c;
+};
+
+class MsdbEnv {
+public:
+    int32_t name;
+    PTR(Val) val;
+    PTR(MsdbEnv) rest;
+    
+    MsdbEnv(int32_t name, PTR(Val) val, PTR(MsdbEnv) rest);
+};
+
+class MsdbImage {
+public:
+    static const uint32_t VERSION = 4;
+    
+    //writes e, parsed from source, in the file format
+    static void write(PTR(Expr) e, std::string source, std::ostream &out);
+    //maps path and checks every node in it, throwing if it is not a whole,
+    //well-formed file of this version
+    static MsdbImage *load(std::string path);
+    ~MsdbImage();
+    
+    //the image of source in the cache directory dir for --ast-cache, compiled
+    //and saved first unless one of the same source from this build is already
+    //there; NULL if there is none and it can't be saved. hit tells which it was
+    static MsdbImage *cached(std::string dir, std::string source, bool *hit = NULL);
+    static uint64_t source_hash(std::string source);
+    //changes whenever the program running it is rebuilt
+    static uint64_t build_id();
+    const MsdbHeader *header;
+    
+    PTR(Val) run();
+    //free variables are looked up by name in globals, Natives::env() by default
+    PTR(Env) globals;
+    
+    PTR(Val) interp(const MsdbNode *node, PTR(MsdbEnv) env);
+    const MsdbNode *child(const MsdbNode *node, int32_t offset);
+    std::string name(int32_t id);
+    //the text the file was compiled from
+    std::string source();
+    //the Expr a node was written from, for printing
+    PTR(Expr) to_expr(const MsdbNode *node);
+    const MsdbNode *root();
+    
+private:
+    const char *bytes;
+    size_t size;
+    //literal values are made once, at load
+    std::vector<PTR(Val)> literals;
+    
+    MsdbImage(const char *bytes, size_t size);
+    void check(std::string path);
+    PTR(Val) lookup(int32_t id, PTR(MsdbEnv) env);
+};
+
+//a _fun from a compiled file, closing over an MsdbEnv
+class MsdbFunVal : public Val {
+public:
+    MsdbImage *image;
+    const MsdbNode *fun;
+    PTR(MsdbEnv) env;
+    static const val_kind_t KIND = val_kind_compiled_fun;
+    
+    MsdbFunVal(MsdbImage *image, const MsdbNode *fun, PTR(MsdbEnv) env);
+    
+    bool equals(PTR(Val) v);
+    PTR(Val) add_to(PTR(Val) rhs);
+    PTR(Val) mult_to(PTR(Val) rhs);
+    void print(std::ostream& output);
+    bool is_true();
+    PTR(Val) call(PTR(Val) actual_arg);
+    void call_step(PTR(Val) actual_arg_val, PTR(Cont) rest);
+};
+
+#endif /* Msdb_h */
@@ -0,0 +1,166 @@
+//
+//  Native.cpp
+//  msdscript
+//
+
+#include "Native.h"
+#include "Env.h"
+#include "Expr.h"
+#include "Step.h"
+#include "Stats.h"
+#include "Cancel.h"
+#include "catch.h"
+#include <stdexcept>
+
+//by multiplying by -1, so -2^63 gives a BigVal
+static PTR(Val) native_abs(PTR(Val) *args){
+    int64_t a = NativeFunVal::num_arg("abs", args[0]);
+    if(a >= 0)
+        return args[0];
+    return args[0]->mult_to(NEW(NumVal)(-1));
+}
+
+static int64_t native_min(int64_t a, int64_t b){
+    return a < b ? a : b;
+}
+
+static int64_t native_max(int64_t a, int64_t b){
+    return a > b ? a : b;
+}
+
+//-2^63 / -1 traps in C++, and its answer only fits in a BigVal
+static PTR(Val) native_div(PTR(Val) *args){
+    int64_t a = NativeFunVal::num_arg("div", args[0]);
+    int64_t b = NativeFunVal::num_arg("div", args[1]);
+    if(b == 0)
+        throw std::runtime_error("division by zero");
+    if(b == -1)
+        return args[0]->mult_to(NEW(NumVal)(-1));
+    return NEW(NumVal)(a / b);
+}
+
+static int64_t native_mod(int64_t a, int64_t b){
+    if(b == 0)
+        throw std::runtime_error("division by zero");
+    //-2^63 % -1 traps too
+    if(b == -1)
+        return 0;
+    return a % b;
+}
+
+//by repeated squaring with *, so a large power becomes a BigVal
+static PTR(Val) native_pow(PTR(Val) *args){
+    PTR(NumVal) exp = KIND_CAST(NumVal)(args[1]);
+    if(exp == NULL || (KIND_CAST(NumVal)(args[0]) == NULL && KIND_CAST(BigVal)(args[0]) == NULL))
+        throw std::runtime_error("pow of non-number");
+    if(exp->val < 0)
+        throw std::runtime_error("pow of negative exponent");
+    PTR(Val) result = NEW(NumVal)(1);
+    PTR(Val) square = args[0];
+    for(int64_t e = exp->val; e > 0; e >>= 1){
+        //a native makes no calls of its own to be cancelled at
+        CancelScope::check();
+        if(e & 1)
+            result = result->mult_to(square);
+        if(e > 1)
+            square = square->mult_to(square);
+    }
+    return result;
+}
+
+//built on first use rather than at static initialization, since it
+//extends Env::empty from another file
+PTR(Env) &Natives::slot(){
+    static PTR(Env) env = NULL;
+    if(env == NULL){
+        env = Env::empty;
+        bind(NEW(NativeFunVal)("abs", 1, native_abs));
+        bind(NEW(NativeFunVal)("min", native_min));
+        bind(NEW(NativeFunVal)("max", native_max));
+        bind(NEW(NativeFunVal)("div", 2, native_div));
+        bind(NEW(NativeFunVal)("mod", native_mod));
+        bind(NEW(NativeFunVal)("pow", 2, native_pow));
+    }
+    return env;
+}
+
+void Natives::bind(PTR(Val) native){
+    PTR(Env) &env = slot();
+    env = NEW(ExtendedEnv)(KIND_CAST(NativeFunVal)(native)->name, native, env);
+}
+
+PTR(Env) Natives::env(){
+    return slot();
+}
+
+void Natives::define(std::string name, int arity, native_fn_t fn){
+    bind(NEW(NativeFunVal)(name, arity, fn));
+}
+
+void Natives::define(std::string name, native_num1_t fn){
+    bind(NEW(NativeFunVal)(name, fn));
+}
+
+void Natives::define(std::string name, native_num2_t fn){
+    bind(NEW(NativeFunVal)(name, fn));
+}
+
+//picks then_val or else_val by a boolean, without the laziness of _if
+static PTR(Val) test_choose(PTR(Val) *args){
+    return args[0]->is_true() ? args[1] : args[2];
+}
+
+static int64_t test_twice(int64_t a){
+    return 2 * a;
+}
+
+//value of in from both engines run in the natives' env, which have to agree
+static std::string run_with_natives(std::string in){
+    PTR(Expr) e = parse_str(in);
+    std::string interp_out = e->interp(Natives::env())->to_string();
+    CHECK(Step::interp_by_steps(e, Natives::env())->to_string() == interp_out);
+    return interp_out;
+}
+
+TEST_CASE("Natives"){
+    CHECK(run_with_natives("abs(-7) + abs(7)") == "14");
+    CHECK(run_with_natives("max(3)(9) + min(3)(9)") == "12");
+    CHECK(run_with_natives("div(-7)(2) + 10 * mod(-7)(2)") == "-13");
+    CHECK(run_with_natives("pow(2)(10)") == "1024");
+    CHECK(run_with_natives("pow(7)(0)") == "1");
+    //partly applied natives are values like any other
+    CHECK(run_with_natives("_let atleast = max(0) _in atleast(-5) + atleast(5)") == "5");
+    CHECK(run_with_natives("_let twice = _fun (f) _fun (x) f(f(x)) _in twice(pow(3))(2)") == "19683");
+    //a program's own bindings shadow natives
+    CHECK(run_with_natives("_let max = _fun (x) x _in max(4)") == "4");
+    CHECK(run_with_natives("max") == "<native max>");
+    CHECK(parse_str("max(1)")->interp(Natives::env())->equals(parse_str("max(1)")->interp(Natives::env())));
+    CHECK(!parse_str("max(1)")->interp(Natives::env())->equals(parse_str("max(2)")->interp(Natives::env())));
+    CHECK(!parse_str("max")->interp(Natives::env())->equals(parse_str("min")->interp(Natives::env())));
+    
+    CHECK_THROWS_WITH(parse_str("div(1)(0)")->interp(Natives::env()), "division by zero");
+    CHECK_THROWS_WITH(Step::interp_by_steps(parse_str("mod(1)(0)"), Natives::env()), "division by zero");
+    CHECK(run_with_natives("div(-2147483648)(-1) + mod(-2147483648)(-1)") == "2147483648");
+    CHECK(run_with_natives("div(-2147483648)(1) + abs(-2147483647)") == "-1");
+    CHECK_THROWS_WITH(parse_str("pow(2)(-1)")->interp(Natives::env()), "pow of negative exponent");
+    CHECK_THROWS_WITH(parse_str("abs(_true)")->interp(Natives::env()), "abs of non-number");
+    CHECK_THROWS_WITH(parse_str("max + 1")->interp(Natives::env()), "addition of non-number");
+    CHECK_THROWS_WITH(parse_str("max")->interp(Env::empty), "free variable: max");
+    
+    Natives::define("testchoose", 3, test_choose);
+    Natives::define("testtwice", test_twice);
+    CHECK(run_with_natives("testchoose(1 == 1)(10)(_false)") == "10");
+    CHECK(run_with_natives("testchoose(1 == 2)(10)(_false)") == "_false");
+    CHECK(run_with_natives("testtwice(21)") == "42");
+    CHECK_THROWS_WITH(Natives::define("testnone", 0, test_choose), "native testnone must take 1 to 4 arguments");
+    
+    //a whole chain of arguments goes straight to the native
+    PTR(Expr) e = parse_str("testchoose(_true)(1)(2) + pow(2)(3)");
+    Stats::reset();
+    Stats::enabled = true;
+    CHECK(e->interp(Natives::env())->equals(NEW(NumVal)(9)));
+    CHECK(Step::interp_by_steps(e, Natives::env())->equals(NEW(NumVal)(9)));
+    Stats::enabled = false;
+    CHECK(Stats::vals[val_kind_native] == 0);
+    CHECK(Stats::step_continues[cont_kind_native_arg] == 5);
+}
@@ -0,0 +1,33 @@
+//
+//  Native.h
+//  msdscript
+//
+
+#ifndef Native_h
+#define Native_h
+
+#include <stdio.h>
+#include <string>
+#include "pointer.h"
+#include "Val.h"
+
+class Env;
+
+//registry of natives for programs to call by name; each define binds one
+//more NativeFunVal in env, which run_mode evaluates programs in, so a
+//program's own bindings shadow natives and anything else is still a free
+//variable. Starts out with integer abs, min, max, div, mod and pow
+class Natives {
+public:
+    static PTR(Env) env();
+    
+    static void define(std::string name, int arity, native_fn_t fn);
+    static void define(std::string name, native_num1_t fn);
+    static void define(std::string name, native_num2_t fn);
+    
+private:
+    static PTR(Env) &slot();
+    static void bind(PTR(Val) native);
+};
+
+#endif /* Native_h */
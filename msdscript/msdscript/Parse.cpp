@@ -12,6 +12,21 @@
 #include "Step.h"
 #include "Cont.h"
 
+//offset of the next character, or -1 if the stream can't seek (like a pipe);
+//asks the streambuf directly because tellg() sets failbit at end of input
+static long source_pos(std::istream &in){
+    return (long)in.rdbuf()->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+}
+
+//fills in whichever end of e's source span an inner parse didn't already set
+static PTR(Expr) spanned(PTR(Expr) e, long start, long end){
+    if(e->span_start < 0)
+        e->span_start = (int)start;
+    if(e->span_end < 0)
+        e->span_end = (int)end;
+    return e;
+}
+
 void consume(std::istream &in, int expect){
     int c = in.get();
     if(c != expect)
@@ -64,24 +79,29 @@ PTR(Expr) parse_str(std::string s){
 }
 
 PTR(Expr) parse_num(std::istream &in){
-    int n = 0;
-    bool negative = false;
+    std::string digits;
     
     if(in.peek() == '-'){
-        negative = true;
+        digits += '-';
         consume(in, '-');
     }
     while(1){
         int c = in.peek();
         if(isdigit(c)){
             consume(in, c);
-            n = n*10 + (c-'0');
+            digits += (char)c;
         }else
             break;
     }
-    if(negative)
-        n = -n;
-    return NEW(NumExpr)(n);
+    //18 digits always fit in an int64_t
+    if(digits.size() <= 18){
+        int64_t n = 0;
+        for(char c : digits)
+            if(c != '-')
+                n = n*10 + (c-'0');
+        return NEW(NumExpr)(digits[0] == '-' ? -n : n);
+    }
+    return NumExpr::literal(digits);
 }
 
 PTR(Expr) parse_expr(std::istream &in){
@@ -94,7 +114,7 @@ PTR(Expr) parse_expr(std::istream &in){
         consume(in, '=');
         consume(in, '=');
         PTR(Expr)rhs = parse_expr(in);
-        return NEW(EqExpr)(e, rhs);
+        return spanned(NEW(EqExpr)(e, rhs), e->span_start, rhs->span_end);
     }else{
         return e;
     }
@@ -107,7 +127,7 @@ PTR(Expr) parse_comparg(std::istream &in){
     if(c == '+'){
         consume(in, '+');
         PTR(Expr) o = parse_comparg(in);
-        return NEW(AddExpr)(exp, o);
+        return spanned(NEW(AddExpr)(exp, o), exp->span_start, o->span_end);
     }else{
         return exp;
     }
@@ -120,7 +140,7 @@ PTR(Expr) parse_addend(std::istream &in){
     if(c == '*') {
         consume(in, '*');
         PTR(Expr)rhs = parse_addend(in);
-        return NEW(MultExpr)(e, rhs);
+        return spanned(NEW(MultExpr)(e, rhs), e->span_start, rhs->span_end);
     }else{
         return e;
     }
@@ -132,17 +152,20 @@ PTR(Expr) parse_multicand(std::istream &in) {
         consume(in, '(');
         PTR(Expr)arg = parse_expr(in);
         consume(in, ')');
+        long end = source_pos(in);
         skip_whitespace(in);
-        expr = NEW(CallExpr)(expr, arg);
+        expr = spanned(NEW(CallExpr)(expr, arg), expr->span_start, end);
     }
     return expr;
 }
 
 PTR(Expr) parse_inner(std::istream &in){
     skip_whitespace(in);
+    long start = source_pos(in);
     int c = in.peek();
     if(( c == '-') || isdigit(c)){
-        return parse_num(in);
+        PTR(Expr)e = parse_num(in);
+        return spanned(e, start, source_pos(in));
     }
     else if(c == '('){
         consume(in, '(');
@@ -151,22 +174,29 @@ PTR(Expr) parse_inner(std::istream &in){
         c = in.get();
         if(c != ')')
             throw std::runtime_error("missing closing parenthesis");
+        //a parenthesized expression's span takes in the parentheses
+        e->span_start = (int)start;
+        e->span_end = (int)source_pos(in);
         return e;
         
-    } else if(isalpha(c))
-        return parse_var(in);
+    } else if(isalpha(c)){
+        PTR(Expr)e = parse_var(in);
+        return spanned(e, start, source_pos(in));
+    }
     else if(c == '_'){
         std::string kw = parse_keyword(in);
         if(kw == "if")
-            return parse_if(in);
+            return spanned(parse_if(in), start, -1);
         else if(kw == "false")
-            return parse_false(in);
+            return spanned(parse_false(in), start, source_pos(in));
         else if(kw == "true")
-            return parse_true(in);
+            return spanned(parse_true(in), start, source_pos(in));
         else if(kw == "let")
-            return parse_let(in);
+            return spanned(parse_let(in), start, -1);
+        else if(kw == "letrec")
+            return spanned(parse_letrec(in), start, -1);
         else if(kw == "fun")
-            return parse_function(in);
+            return spanned(parse_function(in), start, -1);
     }
     consume(in, c);
     throw std::runtime_error("invalid input");
@@ -182,7 +212,24 @@ PTR(Expr) parse_let(std::istream &in){
     if(kw != "in")
         throw std::runtime_error("invalid keyword parsed");
     PTR(Expr)body = parse_expr(in);
-    return NEW(LetExpr)(v->pp_to_string(), rhs, body);
+    PTR(Expr)e = NEW(LetExpr)(v->pp_to_string(), rhs, body);
+    e->span_end = body->span_end;
+    return e;
+}
+
+PTR(Expr) parse_letrec(std::istream &in){
+    PTR(Expr)v = parse_var(in);
+    skip_whitespace(in);
+    consume(in, '=');
+    PTR(Expr)rhs = parse_expr(in);
+    skip_whitespace(in);
+    std::string kw = parse_keyword(in);
+    if(kw != "in")
+        throw std::runtime_error("invalid keyword parsed");
+    PTR(Expr)body = parse_expr(in);
+    PTR(Expr)e = NEW(LetRecExpr)(v->pp_to_string(), rhs, body);
+    e->span_end = body->span_end;
+    return e;
 }
 
 PTR(Expr) parse_if(std::istream &in){
@@ -197,7 +244,9 @@ PTR(Expr) parse_if(std::istream &in){
         throw std::runtime_error("invalid else keyword");
     skip_whitespace(in);
     PTR(Expr)else_part = parse_expr(in);
-    return NEW(IfExpr)(test, then, else_part);
+    PTR(Expr)e = NEW(IfExpr)(test, then, else_part);
+    e->span_end = else_part->span_end;
+    return e;
 }
 
 PTR(Expr) parse_function(std::istream &in){
@@ -207,7 +256,9 @@ PTR(Expr) parse_function(std::istream &in){
     consume(in, ')');
     skip_whitespace(in);
     PTR(Expr)body = parse_expr(in);
-    return NEW(FunExpr)(v->to_string(), body);
+    PTR(Expr)e = NEW(FunExpr)(v->to_string(), body);
+    e->span_end = body->span_end;
+    return e;
 }
 
 PTR(Expr) parse_false(std:: istream &in){
@@ -333,3 +384,16 @@ TEST_CASE("PARSE"){
     ss.str("x");
     CHECK_THROWS_WITH(consume(ss, 1), "consume mismatch");
 }
+
+TEST_CASE("Source Spans"){
+    std::string source = "_let f = _fun (x) x * 2\n_in  f(1) + (3 == 4)";
+    PTR(LetExpr) let = CAST(LetExpr)(parse_str(source));
+    CHECK(let->span_start == 0);
+    CHECK(let->span_end == (int)source.length());
+    CHECK(source.substr(let->rhs->span_start, let->rhs->span_end - let->rhs->span_start) == "_fun (x) x * 2");
+    PTR(AddExpr) sum = CAST(AddExpr)(let->body);
+    CHECK(source.substr(sum->span_start, sum->span_end - sum->span_start) == "f(1) + (3 == 4)");
+    CHECK(source.substr(sum->lhs->span_start, sum->lhs->span_end - sum->lhs->span_start) == "f(1)");
+    CHECK(source.substr(sum->rhs->span_start, sum->rhs->span_end - sum->rhs->span_start) == "(3 == 4)");
+    CHECK((NEW(NumExpr)(1))->span_start == -1);
+}
@@ -32,6 +32,7 @@ PTR(Expr) parse_inner(std::istream &in);
 PTR(Expr) parse_str(std::string s);
 PTR(Expr) parse_var(std::istream &in);
 PTR(Expr) parse_let(std::istream &in);
+PTR(Expr) parse_letrec(std::istream &in);
 PTR(Expr) parse_if(std::istream &in);
 PTR(Expr) parse_false(std::istream &in);
 PTR(Expr) parse_true(std::istream &in);
@@ -0,0 +1,141 @@
+//
+//  PerfCounters.cpp
+//  msdscript
+//
+
+#include "PerfCounters.h"
+#include "catch.h"
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+const char *PerfCounters::names[COUNTERS] = {
+    "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses", "page-faults"
+};
+
+#ifdef __linux__
+static int open_counter(__u32 type, __u64 config){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    //user space only, which perf_event_paranoid allows for unprivileged users
+    attr.exclude_kernel = (type != PERF_TYPE_SOFTWARE);
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static __u64 cache_miss(__u64 cache){
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+PerfCounters::PerfCounters(){
+    for(int i = 0; i < COUNTERS; i++)
+        fds[i] = -1;
+#ifdef __linux__
+    fds[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[2] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds[3] = open_counter(PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D));
+    fds[4] = open_counter(PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL));
+    fds[5] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+#endif
+}
+
+PerfCounters::~PerfCounters(){
+    for(int i = 0; i < COUNTERS; i++){
+        if(fds[i] >= 0)
+            close(fds[i]);
+    }
+}
+
+void PerfCounters::begin(std::string name){
+    current = name;
+#ifdef __linux__
+    for(int i = 0; i < COUNTERS; i++){
+        if(fds[i] >= 0){
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void PerfCounters::end(){
+    Phase phase;
+    phase.name = current;
+    for(int i = 0; i < COUNTERS; i++){
+        phase.counts[i] = -1;
+#ifdef __linux__
+        if(fds[i] >= 0){
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            long long count;
+            if(read(fds[i], &count, sizeof(count)) == sizeof(count))
+                phase.counts[i] = count;
+        }
+#endif
+    }
+    phases.push_back(phase);
+}
+
+void PerfCounters::print(std::ostream &out){
+    out << std::left << std::setw(10) << "phase" << std::right;
+    for(int i = 0; i < COUNTERS; i++)
+        out << std::setw(15) << names[i];
+    out << std::setw(8) << "IPC" << "\n";
+    for(Phase &phase : phases){
+        out << std::left << std::setw(10) << phase.name << std::right;
+        for(int i = 0; i < COUNTERS; i++){
+            if(phase.counts[i] < 0)
+                out << std::setw(15) << "-";
+            else
+                out << std::setw(15) << phase.counts[i];
+        }
+        std::ostringstream ipc;
+        if(phase.counts[0] > 0 && phase.counts[1] >= 0)
+            ipc << std::fixed << std::setprecision(2) << (double)phase.counts[1] / phase.counts[0];
+        else
+            ipc << "-";
+        out << std::setw(8) << ipc.str() << "\n";
+    }
+}
+
+TEST_CASE("Perf Counters"){
+    PerfCounters perf;
+    perf.begin("parse");
+    perf.end();
+    perf.begin("evaluate");
+    //fresh anonymous pages fault in when first written, whatever malloc has cached
+    size_t length = 1 << 20;
+    char *touched = (char *)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    REQUIRE(touched != MAP_FAILED);
+    for(size_t i = 0; i < length; i += 4096)
+        touched[i] = 1;
+    perf.end();
+    munmap(touched, length);
+    REQUIRE(perf.phases.size() == 2);
+    CHECK(perf.phases[0].name == "parse");
+    CHECK(perf.phases[1].name == "evaluate");
+    for(PerfCounters::Phase &phase : perf.phases){
+        for(int i = 0; i < PerfCounters::COUNTERS; i++)
+            CHECK(phase.counts[i] >= -1);
+    }
+    if(perf.phases[1].counts[5] >= 0)
+        CHECK(perf.phases[1].counts[5] > 0);
+    
+    std::stringstream out;
+    perf.print(out);
+    CHECK(out.str().find("phase ") == 0);
+    CHECK(out.str().find(" cycles ") != std::string::npos);
+    CHECK(out.str().find("\nevaluate ") != std::string::npos);
+}
@@ -0,0 +1,43 @@
+//
+//  PerfCounters.h
+//  msdscript
+//
+
+#ifndef PerfCounters_h
+#define PerfCounters_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <ostream>
+
+//hardware and kernel counters for --perf-counters, read around each phase of
+//run_mode through perf_event_open; counters the kernel or CPU won't give us
+//(and every counter off Linux) read as -1 and print as "-"
+class PerfCounters {
+public:
+    static const int COUNTERS = 6;
+    static const char *names[COUNTERS];
+    
+    struct Phase {
+        std::string name;
+        long long counts[COUNTERS];
+    };
+    
+    std::vector<Phase> phases;
+    
+    PerfCounters();
+    ~PerfCounters();
+    
+    //starts counting a new phase; end() stops it and stores the counts
+    void begin(std::string name);
+    void end();
+    
+    void print(std::ostream &out);
+    
+private:
+    int fds[COUNTERS];
+    std::string current;
+};
+
+#endif /* PerfCounters_h */
@@ -0,0 +1,210 @@
+//
+//  Profile.cpp
+//  msdscript
+//
+
+#include "Profile.h"
+#include "catch.h"
+#include "Expr.h"
+#include "Parse.h"
+#include "Val.h"
+#include "Env.h"
+#include <map>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <signal.h>
+#include <sys/time.h>
+
+bool Profile::enabled = false;
+std::string Profile::source;
+volatile int Profile::depth = 0;
+int Profile::capacity = 0;
+const Expr **Profile::functions = NULL;
+const Expr **Profile::active = NULL;
+
+static const int STACK_CAPACITY = 1 << 16;
+//samples keep at most this many of the innermost frames
+static const int SAMPLE_FRAMES = 256;
+static const int BUFFER_INTS = 1 << 20;
+//stands in for the frames a sample left out
+static const int TRUNCATED = -2;
+
+//each sample is [frame count, leaf offset, frame offsets from outermost in]
+static int *buffer = NULL;
+static volatile int buffer_used = 0;
+static long dropped = 0;
+static std::vector<int> line_starts;
+static struct sigaction old_action;
+
+static void on_sigprof(int){
+    Profile::take_sample();
+}
+
+void Profile::start(std::string source, long interval_usec){
+    Profile::source = source;
+    line_starts.clear();
+    line_starts.push_back(0);
+    for(size_t i = 0; i < source.length(); i++){
+        if(source[i] == '\n')
+            line_starts.push_back((int)i + 1);
+    }
+    if(buffer == NULL){
+        buffer = new int[BUFFER_INTS];
+        functions = new const Expr *[STACK_CAPACITY];
+        active = new const Expr *[STACK_CAPACITY];
+    }
+    capacity = STACK_CAPACITY;
+    functions[0] = NULL;
+    active[0] = NULL;
+    depth = 0;
+    buffer_used = 0;
+    dropped = 0;
+    enabled = true;
+    
+    if(interval_usec > 0){
+        struct sigaction action;
+        action.sa_handler = on_sigprof;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGPROF, &action, &old_action);
+        struct itimerval timer;
+        timer.it_interval.tv_sec = interval_usec / 1000000;
+        timer.it_interval.tv_usec = interval_usec % 1000000;
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_PROF, &timer, NULL);
+    }
+}
+
+void Profile::stop(){
+    if(!enabled)
+        return;
+    struct itimerval timer = {{0, 0}, {0, 0}};
+    struct itimerval previous;
+    setitimer(ITIMER_PROF, &timer, &previous);
+    if(previous.it_interval.tv_sec != 0 || previous.it_interval.tv_usec != 0)
+        sigaction(SIGPROF, &old_action, NULL);
+    enabled = false;
+}
+
+static int span_of(const Expr *e){
+    return (e == NULL) ? -1 : e->span_start;
+}
+
+void Profile::take_sample(){
+    int d = depth;
+    int kept = std::min(d, SAMPLE_FRAMES);
+    int truncated = (kept < d) ? 1 : 0;
+    int used = buffer_used;
+    if(used + 2 + truncated + kept > BUFFER_INTS){
+        dropped++;
+        return;
+    }
+    buffer[used] = kept + truncated;
+    int top = (d < capacity) ? d : capacity - 1;
+    buffer[used + 1] = span_of(active[top]);
+    int at = used + 2;
+    if(truncated)
+        buffer[at++] = TRUNCATED;
+    for(int i = d - kept + 1; i <= d; i++)
+        buffer[at++] = (i < capacity) ? span_of(functions[i]) : -1;
+    buffer_used = at;
+}
+
+//1-based line of a source offset
+static size_t line_of(int offset){
+    return std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin();
+}
+
+std::string Profile::location(int offset){
+    if(offset < 0)
+        return "?";
+    size_t line = line_of(offset);
+    std::ostringstream s;
+    s << line << ":" << (offset - line_starts[line - 1] + 1);
+    return s.str();
+}
+
+//names a function by its "_fun (x)" header, which comes right before the body
+static std::string function_name(int body_offset){
+    if(body_offset == TRUNCATED)
+        return "...";
+    if(body_offset < 0)
+        return "_fun";
+    size_t at = (body_offset == 0) ? std::string::npos : Profile::source.rfind("_fun", body_offset - 1);
+    if(at == std::string::npos)
+        return "_fun";
+    std::string name;
+    for(size_t i = at; i < (size_t)body_offset; i++){
+        char c = Profile::source[i];
+        if(isspace(c)){
+            if(!name.empty() && name.back() != ' ')
+                name += ' ';
+        }else if(c != ';')
+            name += c;
+    }
+    while(!name.empty() && name.back() == ' ')
+        name.pop_back();
+    return name + " " + Profile::location((int)at);
+}
+
+void Profile::write_folded(std::ostream &out){
+    std::map<std::string, long> stacks;
+    std::map<int, std::string> names;
+    int at = 0;
+    while(at < buffer_used){
+        int frames = buffer[at];
+        std::string stack = "main";
+        for(int i = 0; i < frames; i++){
+            int offset = buffer[at + 2 + i];
+            if(names.count(offset) == 0)
+                names[offset] = function_name(offset);
+            stack += ";" + names[offset];
+        }
+        int leaf = buffer[at + 1];
+        stack += ";line " + (leaf < 0 ? std::string("?") : std::to_string(line_of(leaf)));
+        stacks[stack]++;
+        at += 2 + frames;
+    }
+    for(auto &stack : stacks)
+        out << stack.first << " " << stack.second << "\n";
+    if(dropped > 0)
+        out << "main;[dropped samples] " << dropped << "\n";
+}
+
+TEST_CASE("Profile"){
+    std::string source = "_let f = _fun (n)\n  n + 1\n_in f(2)";
+    PTR(Expr) e = parse_str(source);
+    PTR(Expr) body = parse_str(source.substr(17));
+    body->span_start += 17;
+    
+    Profile::start(source, 0);
+    {
+        ProfileScope top(&*e);
+        Profile::take_sample();
+        ProfileCall call(&*body);
+        Profile::take_sample();
+        Profile::take_sample();
+    }
+    CHECK(Profile::depth == 0);
+    Profile::stop();
+    
+    std::stringstream out;
+    Profile::write_folded(out);
+    CHECK(out.str() == "main;_fun (n) 1:10;line 2 2\n"
+                       "main;line 1 1\n");
+    CHECK(Profile::location(0) == "1:1");
+    CHECK(Profile::location(20) == "2:3");
+    
+    //with a real timer, a busy program must leave some samples behind
+    source = "_let fib = _fun (f) _fun (n) _if n == 0 _then 0 _else _if n == 1 _then 1\n"
+             "_else f(f)(n + -1) + f(f)(n + -2)\n"
+             "_in fib(fib)(22)";
+    e = parse_str(source);
+    Profile::start(source, 1000);
+    CHECK(e->interp(Env::empty)->equals(NEW(NumVal)(17711)));
+    Profile::stop();
+    out.str("");
+    Profile::write_folded(out);
+    CHECK(out.str().find("main;_fun (n) 1:21;") != std::string::npos);
+}
@@ -0,0 +1,87 @@
+//
+//  Profile.h
+//  msdscript
+//
+
+#ifndef Profile_h
+#define Profile_h
+
+#include <stdio.h>
+#include <string>
+#include <ostream>
+#include "pointer.h"
+
+class Expr;
+
+//sampling profiler for --profile; while enabled, Expr::interp keeps a shadow
+//stack of function calls and the expression active in each one, and a
+//SIGPROF timer copies that stack into a preallocated sample buffer
+class Profile {
+public:
+    static bool enabled;
+    
+    //text the profiled program was parsed from, used to turn spans into lines
+    static std::string source;
+    
+    //function calls in progress; frames past capacity are counted but not kept
+    static volatile int depth;
+    static int capacity;
+    //body of the function running at each depth, NULL at depth 0
+    static const Expr **functions;
+    //innermost expression being interpreted at each depth
+    static const Expr **active;
+    
+    //starts sampling every interval_usec of CPU time, or never if it is 0
+    static void start(std::string source, long interval_usec);
+    static void stop();
+    //records the current shadow stack; this is the signal handler's work
+    static void take_sample();
+    //writes one "frame;frame;line count" row per distinct stack
+    static void write_folded(std::ostream &out);
+    
+    //"line:column" of a source offset
+    static std::string location(int offset);
+};
+
+//marks e as the active expression of the current call while it is interpreted
+class ProfileScope {
+public:
+    ProfileScope(const Expr *e){
+        on = Profile::enabled && Profile::depth < Profile::capacity;
+        if(on){
+            saved = Profile::active[Profile::depth];
+            Profile::active[Profile::depth] = e;
+        }
+    }
+    ~ProfileScope(){
+        if(on)
+            Profile::active[Profile::depth] = saved;
+    }
+private:
+    bool on;
+    const Expr *saved;
+};
+
+//pushes a shadow stack frame for a call to the function with this body
+class ProfileCall {
+public:
+    ProfileCall(const Expr *body){
+        on = Profile::enabled;
+        if(on){
+            int d = Profile::depth + 1;
+            if(d < Profile::capacity){
+                Profile::functions[d] = body;
+                Profile::active[d] = body;
+            }
+            Profile::depth = d;
+        }
+    }
+    ~ProfileCall(){
+        if(on)
+            Profile::depth = Profile::depth - 1;
+    }
+private:
+    bool on;
+};
+
+#endif /* Profile_h */
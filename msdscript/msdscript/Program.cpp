@@ -0,0 +1,220 @@
+//
+//  Program.cpp
+//  msdscript
+//
+
+#include "Program.h"
+#include "Expr.h"
+#include "Val.h"
+#include "Env.h"
+#include "Step.h"
+#include "Native.h"
+#include "Cancel.h"
+#include "catch.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdexcept>
+
+//the walk collect_free makes: the names bound around the current expression,
+//counted since an inner binding can shadow an outer one of the same name, and
+//the free names found so far in the order they first appear
+struct FreeVars {
+    std::unordered_map<std::string, int> bound;
+    std::unordered_set<std::string> seen;
+    std::vector<std::string> found;
+    
+    void bind(const std::string &name){
+        bound[name]++;
+    }
+    void unbind(const std::string &name){
+        if(--bound[name] == 0)
+            bound.erase(name);
+    }
+};
+
+//adds the free variables of e to vars.found
+static void collect_free(PTR(Expr) e, FreeVars &vars){
+    switch(e->kind){
+        case expr_kind_num:
+        case expr_kind_bool:
+            return;
+        case expr_kind_var: {
+            std::string name = KIND_CAST(VarExpr)(e)->var;
+            if(vars.bound.count(name) == 0 && vars.seen.insert(name).second)
+                vars.found.push_back(name);
+            return;
+        }
+        case expr_kind_add:
+            collect_free(KIND_CAST(AddExpr)(e)->lhs, vars);
+            collect_free(KIND_CAST(AddExpr)(e)->rhs, vars);
+            return;
+        case expr_kind_mult:
+            collect_free(KIND_CAST(MultExpr)(e)->lhs, vars);
+            collect_free(KIND_CAST(MultExpr)(e)->rhs, vars);
+            return;
+        case expr_kind_eq:
+            collect_free(KIND_CAST(EqExpr)(e)->lhs, vars);
+            collect_free(KIND_CAST(EqExpr)(e)->rhs, vars);
+            return;
+        case expr_kind_call:
+            collect_free(KIND_CAST(CallExpr)(e)->to_be_called, vars);
+            collect_free(KIND_CAST(CallExpr)(e)->actual_arg, vars);
+            return;
+        case expr_kind_if: {
+            PTR(IfExpr) i = KIND_CAST(IfExpr)(e);
+            collect_free(i->test_part, vars);
+            collect_free(i->then_part, vars);
+            collect_free(i->else_part, vars);
+            return;
+        }
+        case expr_kind_let: {
+            PTR(LetExpr) let = KIND_CAST(LetExpr)(e);
+            collect_free(let->rhs, vars);
+            vars.bind(let->lhs);
+            collect_free(let->body, vars);
+            vars.unbind(let->lhs);
+            return;
+        }
+        case expr_kind_letrec: {
+            PTR(LetRecExpr) let = KIND_CAST(LetRecExpr)(e);
+            vars.bind(let->lhs);
+            collect_free(let->rhs, vars);
+            collect_free(let->body, vars);
+            vars.unbind(let->lhs);
+            return;
+        }
+        case expr_kind_fun: {
+            PTR(FunExpr) fun = KIND_CAST(FunExpr)(e);
+            vars.bind(fun->formal_arg);
+            collect_free(fun->body, vars);
+            vars.unbind(fun->formal_arg);
+            return;
+        }
+    }
+}
+
+Program::Program(std::string source){
+    this->expr = parse_str(source);
+    this->plan_tried = false;
+    this->plan_ok = false;
+    FreeVars vars;
+    collect_free(expr, vars);
+    free_vars = vars.found;
+}
+
+Program::Program(PTR(Expr) expr){
+    this->expr = expr;
+    this->plan_tried = false;
+    this->plan_ok = false;
+    FreeVars vars;
+    collect_free(expr, vars);
+    free_vars = vars.found;
+}
+
+PTR(Env) Program::bind(const std::map<std::string, PTR(Val)> &bindings){
+    PTR(Env) env = Natives::env();
+    for(auto &binding : bindings){
+        if(std::find(free_vars.begin(), free_vars.end(), binding.first) == free_vars.end())
+            throw std::runtime_error("program has no free variable " + binding.first);
+        env = NEW(ExtendedEnv)(binding.first, binding.second, env);
+    }
+    return env;
+}
+
+PTR(Val) Program::run(const std::map<std::string, PTR(Val)> &bindings, CancelToken *cancel){
+    CancelScope scope(cancel);
+    return expr->interp(bind(bindings));
+}
+
+PTR(Val) Program::run(const std::vector<PTR(Val)> &values, CancelToken *cancel){
+    if(values.size() > free_vars.size())
+        throw std::runtime_error("program has only " + std::to_string(free_vars.size()) + " free variables");
+    PTR(Env) env = Natives::env();
+    for(size_t i = 0; i < values.size(); i++)
+        env = NEW(ExtendedEnv)(free_vars[i], values[i], env);
+    CancelScope scope(cancel);
+    return expr->interp(env);
+}
+
+PTR(Val) Program::run_by_steps(const std::map<std::string, PTR(Val)> &bindings, CancelToken *cancel){
+    return Step::interp_by_steps(expr, bind(bindings), cancel);
+}
+
+std::vector<int> Program::run_columns(const std::map<std::string, std::vector<int>> &columns){
+    std::vector<std::string> inputs;
+    std::vector<const int *> data;
+    size_t rows = columns.empty() ? 0 : columns.begin()->second.size();
+    for(auto &column : columns){
+        if(std::find(free_vars.begin(), free_vars.end(), column.first) == free_vars.end())
+            throw std::runtime_error("program has no free variable " + column.first);
+        if(column.second.size() != rows)
+            throw std::runtime_error("columns differ in length");
+        inputs.push_back(column.first);
+        data.push_back(column.second.data());
+    }
+    
+    if(!plan_tried || inputs != plan_inputs){
+        plan_ok = plan.compile(expr, inputs);
+        plan_inputs = inputs;
+        plan_tried = true;
+    }
+    std::vector<int> out(rows);
+    if(!plan_ok){
+        run_rows(inputs, data, 0, rows, out.data());
+        return out;
+    }
+    std::vector<size_t> overflowed;
+    plan.run(data, rows, out.data(), &overflowed);
+    for(size_t start : overflowed)
+        run_rows(inputs, data, start, std::min(rows, start + ColumnPlan::BLOCK), out.data());
+    return out;
+}
+
+void Program::run_rows(const std::vector<std::string> &inputs, const std::vector<const int *> &data, size_t first, size_t last, int *out){
+    for(size_t row = first; row < last; row++){
+        std::map<std::string, PTR(Val)> bindings;
+        for(size_t i = 0; i < inputs.size(); i++)
+            bindings[inputs[i]] = NEW(NumVal)(data[i][row]);
+        PTR(Val) v = run(bindings);
+        PTR(NumVal) num = KIND_CAST(NumVal)(v);
+        PTR(BoolVal) b = KIND_CAST(BoolVal)(v);
+        if(b != NULL)
+            out[row] = b->boolVal;
+        else if(num != NULL && num->val >= INT32_MIN && num->val <= INT32_MAX)
+            out[row] = (int)num->val;
+        else if(num != NULL || KIND_CAST(BigVal)(v) != NULL)
+            throw std::runtime_error("run_columns result does not fit in an int");
+        else
+            throw std::runtime_error("run_columns needs a number or boolean result");
+    }
+}
+
+TEST_CASE("Program"){
+    Program area("_let square = _fun (x) x * x _in square(width) + height * width");
+    CHECK(area.free_vars == std::vector<std::string>({"width", "height"}));
+    CHECK(area.run({{"width", NEW(NumVal)(3)}, {"height", NEW(NumVal)(2)}})->equals(NEW(NumVal)(15)));
+    CHECK(area.run({{"width", NEW(NumVal)(4)}, {"height", NEW(NumVal)(1)}})->equals(NEW(NumVal)(20)));
+    CHECK(area.run_by_steps({{"width", NEW(NumVal)(4)}, {"height", NEW(NumVal)(1)}})->equals(NEW(NumVal)(20)));
+    CHECK(area.run(std::vector<PTR(Val)>({NEW(NumVal)(5), NEW(NumVal)(0)}))->equals(NEW(NumVal)(25)));
+    
+    CHECK_THROWS_WITH(area.run({{"width", NEW(NumVal)(1)}}), "free variable: height");
+    CHECK_THROWS_WITH(area.run({{"widht", NEW(NumVal)(1)}}), "program has no free variable widht");
+    CHECK_THROWS_WITH(area.run(std::vector<PTR(Val)>(3, NEW(NumVal)(1))), "program has only 2 free variables");
+    
+    //names bound anywhere in scope aren't free, and natives fill in the rest
+    Program scoped("_letrec f = _fun (n) _if n == 0 _then k _else f(n + -1) _in (_let k = 1 _in k) + f(max(n)(0))");
+    CHECK(scoped.free_vars == std::vector<std::string>({"k", "max", "n"}));
+    //a name bound twice stays bound until both scopes end
+    Program shadowed("_let x = 1 _in (_let x = 2 _in x) + x + (_fun (y) _let y = y _in y)(y)");
+    CHECK(shadowed.free_vars == std::vector<std::string>({"y"}));
+    CHECK(scoped.run({{"k", NEW(NumVal)(7)}, {"n", NEW(NumVal)(-3)}})->equals(NEW(NumVal)(8)));
+    //and bindings can stand in for natives
+    CHECK(scoped.run({{"k", NEW(NumVal)(7)}, {"n", NEW(NumVal)(3)}, {"max", parse_str("_fun (a) _fun (b) 0")->interp(Env::empty)}})->equals(NEW(NumVal)(8)));
+    
+    //functions go in like any other value
+    Program apply("f(2)");
+    CHECK(apply.run({{"f", parse_str("_fun (x) x * 21")->interp(Env::empty)}})->equals(NEW(NumVal)(42)));
+    CHECK(Program(parse_str("1 + 1")).free_vars.empty());
+    CHECK_THROWS_WITH(Program("1 +"), "invalid input");
+}
@@ -0,0 +1,62 @@
+//
+//  Program.h
+//  msdscript
+//
+
+#ifndef Program_h
+#define Program_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "pointer.h"
+#include "Columns.h"
+
+class Expr;
+class Val;
+class Env;
+class CancelToken;
+
+//a program parsed and analyzed once, for embedders that run it many times
+//with different values for its free variables. A free variable gets its
+//value from the bindings of a run, or else from the natives; one with
+//neither is still a "free variable" error if the run reaches it
+class Program {
+public:
+    PTR(Expr) expr;
+    //every variable used without a _let, _letrec or _fun around it, in
+    //order of first use
+    std::vector<std::string> free_vars;
+    
+    Program(std::string source);
+    Program(PTR(Expr) expr);
+    
+    //throws for a binding no free variable uses, which is likely a typo.
+    //Each run stops with EvalCancelled once cancel is cancelled
+    PTR(Val) run(const std::map<std::string, PTR(Val)> &bindings, CancelToken *cancel = NULL);
+    //values[i] is bound to free_vars[i]; shorter than free_vars leaves the
+    //rest unbound
+    PTR(Val) run(const std::vector<PTR(Val)> &values, CancelToken *cancel = NULL);
+    //same as run, through the step machine, for programs that recurse too
+    //deeply for the C++ stack
+    PTR(Val) run_by_steps(const std::map<std::string, PTR(Val)> &bindings, CancelToken *cancel = NULL);
+    //one result per row, for inputs given as columns of the same length;
+    //booleans come back as 1 and 0. Goes through a ColumnPlan when the
+    //program fits one, or else runs each row through run, as do the
+    //blocks of rows where the plan overflowed an int
+    std::vector<int> run_columns(const std::map<std::string, std::vector<int>> &columns);
+    
+private:
+    ColumnPlan plan;
+    //the inputs plan was compiled for, and whether it could be
+    std::vector<std::string> plan_inputs;
+    bool plan_tried;
+    bool plan_ok;
+    
+    PTR(Env) bind(const std::map<std::string, PTR(Val)> &bindings);
+    //rows first to last of run_columns, through run
+    void run_rows(const std::vector<std::string> &inputs, const std::vector<const int *> &data, size_t first, size_t last, int *out);
+};
+
+#endif /* Program_h */
@@ -0,0 +1,262 @@
+//
+//  ResultCache.cpp
+//  msdscript
+//
+
+#include "ResultCache.h"
+#include "Expr.h"
+#include "catch.h"
+#include "cmdline.h"
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+const char *ResultCache::VERSION = "msdscript 4";
+
+//what every file of ours starts with, so trim never touches anything else
+static const std::string PREFIX = "msd-";
+
+ResultCache::ResultCache(std::string dir, long max_bytes){
+    if(mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+        throw std::runtime_error("cannot create cache directory " + dir);
+    this->dir = dir;
+    this->max_bytes = max_bytes;
+    this->raw_hits = 0;
+    this->normalized_hits = 0;
+    this->misses = 0;
+    this->temp_count = 0;
+}
+
+//64-bit FNV-1a
+static uint64_t fnv1a(uint64_t hash, const std::string &s){
+    for(size_t i = 0; i < s.size(); i++){
+        hash ^= (unsigned char)s[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string ResultCache::key(std::string mode, std::string text){
+    return std::string(VERSION) + '\0' + mode + '\0' + text;
+}
+
+//kind is 'r' for raw program text or 'n' for normalized
+std::string ResultCache::path(char kind, std::string key){
+    uint64_t hash = fnv1a(14695981039346656037ULL, key);
+    char name[32];
+    snprintf(name, sizeof(name), "%c-%016llx", kind, (unsigned long long)hash);
+    return dir + "/" + PREFIX + name;
+}
+
+//a file is the key's length, a newline, the key and then the result
+bool ResultCache::read(std::string path, std::string key, std::string &result){
+    std::ifstream in(path, std::ios::binary);
+    if(!in)
+        return false;
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    std::string file = contents.str();
+    std::string header = std::to_string(key.size()) + "\n";
+    if(file.compare(0, header.size(), header) != 0 || file.compare(header.size(), key.size(), key) != 0)
+        return false;
+    result = file.substr(header.size() + key.size());
+    //a hit counts as a use for trim
+    utimes(path.c_str(), NULL);
+    return true;
+}
+
+//best effort: a result that can't be written is just not cached
+void ResultCache::write(std::string path, std::string key, std::string result){
+    std::string contents = std::to_string(key.size()) + "\n" + key + result;
+    std::string temp = dir + "/" + PREFIX + "tmp-" + std::to_string((long)getpid()) + "-" + std::to_string(temp_count++);
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if(fd < 0)
+        return;
+    size_t done = 0;
+    while(done < contents.size()){
+        ssize_t n = ::write(fd, contents.data() + done, contents.size() - done);
+        if(n <= 0)
+            break;
+        done += n;
+    }
+    if(close(fd) != 0 || done != contents.size() || rename(temp.c_str(), path.c_str()) != 0){
+        unlink(temp.c_str());
+        return;
+    }
+    trim();
+}
+
+struct CacheFile {
+    std::string path;
+    long size;
+    time_t used;
+};
+
+void ResultCache::trim(){
+    DIR *d = opendir(dir.c_str());
+    if(d == NULL)
+        return;
+    std::vector<CacheFile> files;
+    long total = 0;
+    while(struct dirent *ent = readdir(d)){
+        std::string name = ent->d_name;
+        if(name.compare(0, PREFIX.size() + 2, PREFIX + "r-") != 0 && name.compare(0, PREFIX.size() + 2, PREFIX + "n-") != 0)
+            continue;
+        std::string file = dir + "/" + name;
+        struct stat st;
+        if(stat(file.c_str(), &st) != 0)
+            continue;
+        files.push_back({file, (long)st.st_size, st.st_mtime});
+        total += (long)st.st_size;
+    }
+    closedir(d);
+    if(total <= max_bytes)
+        return;
+    std::sort(files.begin(), files.end(), [](const CacheFile &a, const CacheFile &b){
+        return a.used < b.used;
+    });
+    for(size_t i = 0; i < files.size() && total > max_bytes; i++){
+        if(unlink(files[i].path.c_str()) == 0)
+            total -= files[i].size;
+    }
+}
+
+bool ResultCache::find_raw(std::string mode, std::string source, std::string &result){
+    std::string k = key(mode, source);
+    if(!read(path('r', k), k, result))
+        return false;
+    raw_hits++;
+    return true;
+}
+
+bool ResultCache::find_normalized(std::string mode, PTR(Expr) e, std::string &result){
+    std::string k = key(mode, e->to_string());
+    if(!read(path('n', k), k, result)){
+        misses++;
+        return false;
+    }
+    normalized_hits++;
+    return true;
+}
+
+void ResultCache::store_raw(std::string mode, std::string source, std::string result){
+    std::string k = key(mode, source);
+    write(path('r', k), k, result);
+}
+
+void ResultCache::store_normalized(std::string mode, PTR(Expr) e, std::string result){
+    std::string k = key(mode, e->to_string());
+    write(path('n', k), k, result);
+}
+
+//names of our files in dir, sorted
+static std::vector<std::string> cache_files(std::string dir){
+    std::vector<std::string> names;
+    DIR *d = opendir(dir.c_str());
+    while(struct dirent *ent = readdir(d)){
+        if(std::string(ent->d_name).compare(0, PREFIX.size(), PREFIX) == 0)
+            names.push_back(ent->d_name);
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+TEST_CASE("Result Cache"){
+    char dir_template[] = "/tmp/msdcacheXXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    ResultCache cache(dir, 1 << 20);
+    
+    std::stringstream out;
+    std::istringstream first("_let x = 2 _in x * 21");
+    run_mode("--interp", first, out, NULL, &cache);
+    CHECK(out.str() == "42\n");
+    CHECK(cache.misses == 1);
+    CHECK(cache_files(dir).size() == 2);
+    
+    //the same text needs no parse; a respelling of it needs no evaluation
+    std::istringstream again("_let x = 2 _in x * 21");
+    run_mode("--interp", again, out, NULL, &cache);
+    CHECK(cache.raw_hits == 1);
+    std::istringstream spaced("_let x=2 _in (x*21)");
+    run_mode("--interp", spaced, out, NULL, &cache);
+    CHECK(cache.normalized_hits == 1);
+    CHECK(out.str() == "42\n42\n42\n");
+    CHECK(cache_files(dir).size() == 3);
+    
+    //modes are kept apart, and only evaluations are cached
+    std::istringstream stepped("_let x = 2 _in x * 21");
+    run_mode("--step", stepped, out, NULL, &cache);
+    CHECK(cache.misses == 2);
+    std::istringstream printed("_let x = 2 _in x * 21");
+    std::stringstream print_out;
+    run_mode("--print", printed, print_out, NULL, &cache);
+    CHECK(cache.misses == 2);
+    std::istringstream failing("1 + _true");
+    CHECK_THROWS_WITH(run_mode("--interp", failing, out, NULL, &cache), "add of non-number");
+    CHECK(cache_files(dir).size() == 5);
+    
+    //a raw hit is answered before parsing is tried
+    cache.store_raw("--interp", "not a program", "7");
+    std::istringstream planted("not a program");
+    run_mode("--interp", planted, out, NULL, &cache);
+    CHECK(out.str() == "42\n42\n42\n42\n7\n");
+    
+    //a cached result is no answer to a run under a limit
+    std::string countdown = "_letrec f = _fun (n) _if n == 0 _then 0 _else f(n + -1) _in f(50)";
+    std::istringstream unlimited(countdown);
+    std::stringstream countdown_out;
+    run_mode("--interp", unlimited, countdown_out, NULL, &cache);
+    std::istringstream fueled(countdown);
+    CHECK_THROWS_WITH(run_mode("--interp", fueled, countdown_out, NULL, &cache, 3), "out of fuel after 3 steps");
+    CHECK(countdown_out.str() == "0\n");
+    std::istringstream limited(countdown);
+    CHECK_THROWS_WITH(run_mode("--interp", limited, countdown_out, NULL, &cache, -1, 0), "memory limit of 0 bytes exceeded");
+    CHECK(countdown_out.str() == "0\n");
+    
+    //a file under the right name but for another key is a miss, as when
+    //two programs' hashes collide
+    std::vector<std::string> before = cache_files(dir);
+    cache.store_raw("--interp", "collide a", "1");
+    cache.store_raw("--interp", "collide b", "2");
+    std::vector<std::string> added;
+    for(std::string name : cache_files(dir)){
+        if(std::find(before.begin(), before.end(), name) == before.end())
+            added.push_back(name);
+    }
+    REQUIRE(added.size() == 2);
+    std::ifstream first_in(dir + "/" + added[0], std::ios::binary);
+    std::string first_file((std::istreambuf_iterator<char>(first_in)), std::istreambuf_iterator<char>());
+    bool first_is_a = first_file.find("collide a") != std::string::npos;
+    std::string a_path = dir + "/" + added[first_is_a ? 0 : 1];
+    std::string b_path = dir + "/" + added[first_is_a ? 1 : 0];
+    CHECK(rename(b_path.c_str(), a_path.c_str()) == 0);
+    std::string found;
+    CHECK(!cache.find_raw("--interp", "collide a", found));
+    CHECK(!cache.find_raw("--interp", "collide b", found));
+    
+    //files go once the directory is over its cap
+    ResultCache small(dir, 8);
+    std::istringstream other("1 + 2");
+    run_mode("--interp", other, out, NULL, &small);
+    long total = 0;
+    for(std::string name : cache_files(dir)){
+        struct stat st;
+        stat((dir + "/" + name).c_str(), &st);
+        total += (long)st.st_size;
+    }
+    CHECK(total <= 8);
+    
+    for(std::string name : cache_files(dir))
+        unlink((dir + "/" + name).c_str());
+    rmdir(dir.c_str());
+    CHECK_THROWS_WITH(ResultCache("/dev/null/cache", 100), "cannot create cache directory /dev/null/cache");
+}
@@ -0,0 +1,59 @@
+//
+//  ResultCache.h
+//  msdscript
+//
+
+#ifndef ResultCache_h
+#define ResultCache_h
+
+#include <stdio.h>
+#include <string>
+#include "pointer.h"
+
+class Expr;
+
+//on-disk cache of printed results for --cache, so a program that already ran
+//is answered without being evaluated again. Each result is stored twice: under
+//a hash of the program text exactly as given, which is found without even
+//parsing, and under a hash of the parsed program's to_string, which still
+//matches when only spacing or parentheses changed. Both hashes cover VERSION
+//and the mode. A file starts with the whole key it was stored under, and a
+//file whose key is not the one looked up is a miss, so two programs whose
+//hashes collide never get each other's result. Files are written under a
+//temporary name and renamed into place, so a reader sees a whole result or
+//none; once the directory holds more than max_bytes, the least recently used
+//files are removed
+class ResultCache {
+public:
+    //change whenever a change to the interpreter could print a different
+    //value for some program
+    static const char *VERSION;
+    
+    std::string dir;
+    long max_bytes;
+    
+    long raw_hits;
+    long normalized_hits;
+    long misses;
+    
+    ResultCache(std::string dir, long max_bytes);
+    
+    //the stored result for this program text, without parsing it
+    bool find_raw(std::string mode, std::string source, std::string &result);
+    //the stored result for any program that parses to e
+    bool find_normalized(std::string mode, PTR(Expr) e, std::string &result);
+    void store_raw(std::string mode, std::string source, std::string result);
+    void store_normalized(std::string mode, PTR(Expr) e, std::string result);
+    
+private:
+    long temp_count;
+    
+    //what a result is stored under: VERSION, the mode and the text
+    static std::string key(std::string mode, std::string text);
+    std::string path(char kind, std::string key);
+    bool read(std::string path, std::string key, std::string &result);
+    void write(std::string path, std::string key, std::string result);
+    void trim();
+};
+
+#endif /* ResultCache_h */
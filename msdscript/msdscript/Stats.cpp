@@ -0,0 +1,142 @@
+//
+//  Stats.cpp
+//  msdscript
+//
+
+#include "Stats.h"
+#include "Env.h"
+#include "Step.h"
+#include <iomanip>
+#include <sstream>
+
+bool Stats::enabled = false;
+long Stats::step_interps[EXPR_KINDS];
+long Stats::step_continues[CONT_KINDS];
+long Stats::vals[VAL_KINDS];
+long Stats::envs;
+long Stats::frames;
+long Stats::max_cont_depth;
+long Stats::lookups[LOOKUP_BUCKETS];
+long Stats::lookup_links;
+
+static const char *expr_names[Stats::EXPR_KINDS] = {
+    "NumExpr", "AddExpr", "MultExpr", "VarExpr", "LetExpr",
+    "BoolExpr", "EqExpr", "IfExpr", "FunExpr", "CallExpr", "LetRecExpr"
+};
+
+static const char *val_names[Stats::VAL_KINDS] = {
+    "NumVal", "BoolVal", "FunVal", "NativeFunVal", "MsdbFunVal", "BigVal"
+};
+
+static const char *cont_names[Stats::CONT_KINDS] = {
+    "DoneCont", "RightThenAddCont", "AddCont", "RightThenMultCont", "MultCont",
+    "IfBranchCont", "LetBodyCont", "RightThenEqCont", "EqCont", "ArgThenCallCont", "CallCont",
+    "LetRecBodyCont", "ChainHeadCont", "ChainArgCont", "NativeArgCont",
+    "MemoStoreCont"
+};
+
+const char *Stats::expr_name(int kind){
+    return (kind >= 0 && kind < EXPR_KINDS) ? expr_names[kind] : "?";
+}
+
+const char *Stats::cont_name(int kind){
+    return (kind >= 0 && kind < CONT_KINDS) ? cont_names[kind] : "?";
+}
+
+void Stats::reset(){
+    for(int i = 0; i < EXPR_KINDS; i++)
+        step_interps[i] = 0;
+    for(int i = 0; i < CONT_KINDS; i++)
+        step_continues[i] = 0;
+    for(int i = 0; i < VAL_KINDS; i++)
+        vals[i] = 0;
+    for(int i = 0; i < LOOKUP_BUCKETS; i++)
+        lookups[i] = 0;
+    envs = 0;
+    frames = 0;
+    max_cont_depth = 0;
+    lookup_links = 0;
+}
+
+PTR(Val) Stats::counted_lookup(PTR(Env) env, std::string name){
+    long before = lookup_links;
+    PTR(Val) val = env->lookup(name);
+    long links = lookup_links - before;
+    int bucket = 0;
+    while(bucket < LOOKUP_BUCKETS - 1 && (1L << bucket) < links)
+        bucket++;
+    lookups[bucket]++;
+    return val;
+}
+
+static void print_row(std::ostream &out, std::string name, long count){
+    out << "  " << std::left << std::setw(20) << name << std::right << std::setw(12) << count << "\n";
+}
+
+void Stats::print(std::ostream &out){
+    out << "step_interp calls\n";
+    for(int i = 0; i < EXPR_KINDS; i++){
+        if(step_interps[i] > 0)
+            print_row(out, expr_names[i], step_interps[i]);
+    }
+    out << "step_continue calls\n";
+    for(int i = 0; i < CONT_KINDS; i++){
+        if(step_continues[i] > 0)
+            print_row(out, cont_names[i], step_continues[i]);
+    }
+    out << "continuations\n";
+    print_row(out, "max depth", max_cont_depth);
+    out << "allocations\n";
+    for(int i = 0; i < VAL_KINDS; i++)
+        print_row(out, val_names[i], vals[i]);
+    print_row(out, "ExtendedEnv", envs);
+    print_row(out, "FrameEnv", frames);
+    out << "env lookup chain length\n";
+    for(int i = 0; i < LOOKUP_BUCKETS; i++){
+        if(lookups[i] == 0)
+            continue;
+        std::ostringstream range;
+        long low = (i == 0) ? 1 : (1L << (i - 1)) + 1;
+        long high = 1L << i;
+        if(low >= high)
+            range << high;
+        else
+            range << low << "-" << high;
+        print_row(out, range.str(), lookups[i]);
+    }
+}
+
+TEST_CASE("Stats"){
+    //NumExprs make their NumVal when parsed, so only the three sums count
+    PTR(Expr) e = parse_str("_let f = _fun (x) x + 1 _in f(2) + f(3)");
+    Stats::reset();
+    Stats::enabled = true;
+    Step::interp_by_steps(e);
+    Stats::enabled = false;
+    
+    CHECK(Stats::step_interps[expr_kind_let] == 1);
+    CHECK(Stats::step_interps[expr_kind_call] == 2);
+    CHECK(Stats::step_interps[expr_kind_var] == 4);
+    CHECK(Stats::step_continues[cont_kind_call] == 2);
+    CHECK(Stats::step_continues[cont_kind_add] == 3);
+    CHECK(Stats::vals[val_kind_fun] == 1);
+    CHECK(Stats::vals[val_kind_num] == 3);
+    CHECK(Stats::envs == 3);
+    CHECK(Stats::lookups[0] == 4);
+    CHECK(Stats::max_cont_depth == 2);
+    
+    std::stringstream out;
+    Stats::print(out);
+    CHECK(out.str().find("  CallExpr                       2\n") != std::string::npos);
+    
+    Stats::reset();
+    Stats::enabled = true;
+    PTR(Env) env = Env::empty;
+    CHECK_THROWS_WITH(Stats::counted_lookup(env, "y"), "free variable: y");
+    PTR(Expr) let = NEW(LetExpr)("x", NEW(NumExpr)(1), NEW(LetExpr)("y", NEW(NumExpr)(2), NEW(VarExpr)("x")));
+    let->interp(Env::empty);
+    Stats::enabled = false;
+    CHECK(Stats::lookups[1] == 1);
+    CHECK(Stats::vals[val_kind_num] == 2);
+    CHECK(Stats::envs == 2);
+}
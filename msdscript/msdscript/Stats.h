@@ -0,0 +1,51 @@
+//
+//  Stats.h
+//  msdscript
+//
+
+#ifndef Stats_h
+#define Stats_h
+
+#include <stdio.h>
+#include <string>
+#include <ostream>
+#include "pointer.h"
+#include "Expr.h"
+#include "Val.h"
+#include "Cont.h"
+
+class Env;
+
+//work counters for --stats; nothing is counted unless enabled is set
+class Stats {
+public:
+    static const int EXPR_KINDS = expr_kind_letrec + 1;
+    static const int VAL_KINDS = val_kind_big + 1;
+    static const int CONT_KINDS = cont_kind_memo_store + 1;
+    //bucket i holds lookups that walked 2^(i-1)+1 to 2^i links
+    static const int LOOKUP_BUCKETS = 32;
+    
+    static bool enabled;
+    
+    static long step_interps[EXPR_KINDS];
+    static long step_continues[CONT_KINDS];
+    static long vals[VAL_KINDS];
+    static long envs;
+    static long frames;
+    static long max_cont_depth;
+    static long lookups[LOOKUP_BUCKETS];
+    
+    //ExtendedEnv and FrameEnv links visited by lookups so far
+    static long lookup_links;
+    
+    static void reset();
+    //env->lookup(name), recording how long a chain it walked
+    static PTR(Val) counted_lookup(PTR(Env) env, std::string name);
+    static void print(std::ostream &out);
+    
+    //class names for each kind
+    static const char *expr_name(int kind);
+    static const char *cont_name(int kind);
+};
+
+#endif /* Stats_h */
@@ -6,28 +6,102 @@
 //
 
 #include "Step.h"
+#include "Stats.h"
+#include "Trace.h"
+#include <limits.h>
 
 Step::mode_t Step::mode;
 PTR(Expr) Step::expr;
 PTR(Env) Step::env;
 PTR(Val) Step::val;
 PTR(Cont) Step::cont;
+long Step::steps;
 
-PTR(Val) Step::interp_by_steps(PTR(Expr) e){
+PTR(Val) Step::interp_by_steps(PTR(Expr) e, PTR(Env) env, CancelToken *cancel){
     Step::mode = Step::interp_mode;
     Step::expr = e;
-    Step::env = Env::empty;
+    Step::env = env;
     Step::val = nullptr;
     Step::cont = Cont::done;
+    Step::steps = 0;
+    return run(cancel);
+}
+
+PTR(Val) Step::resume(const OutOfFuel &stopped, CancelToken *cancel){
+    if(!stopped.resumable)
+        throw std::runtime_error("cannot resume from out of fuel in interp");
+    Step::mode = stopped.interp_mode ? Step::interp_mode : Step::continue_mode;
+    Step::expr = stopped.expr;
+    Step::env = stopped.env;
+    Step::val = stopped.val;
+    Step::cont = stopped.cont;
+    Step::steps = stopped.steps;
+    return run(cancel);
+}
+
+//charges fuel for the steps a run took, however the run ends; until then
+//the run only compares Step::steps against where the fuel gives out
+class FuelMeter {
+public:
+    Fuel *fuel;
+    long start;
+    long limit;
+    
+    FuelMeter(Fuel *fuel){
+        this->fuel = fuel;
+        this->start = Step::steps;
+        this->limit = fuel != NULL ? Step::steps + fuel->remaining : LONG_MAX;
+    }
+    ~FuelMeter(){
+        if(fuel != NULL){
+            fuel->remaining -= Step::steps - start;
+            fuel->used += Step::steps - start;
+        }
+    }
+    
+    //saves the machine before the step there is no fuel for
+    void out_of_fuel(){
+        OutOfFuel stopped(fuel->used + Step::steps - start);
+        stopped.resumable = true;
+        stopped.interp_mode = Step::mode == Step::interp_mode;
+        stopped.expr = Step::expr;
+        stopped.env = Step::env;
+        stopped.val = Step::val;
+        stopped.cont = Step::cont;
+        stopped.steps = Step::steps;
+        throw stopped;
+    }
+};
+
+PTR(Val) Step::run(CancelToken *cancel){
+    CancelScope scope(cancel);
+    CancelToken *token = CancelScope::current;
+    FuelMeter meter(FuelScope::current);
     
     while(true){
-        if(Step::mode == Step::interp_mode)
+        if(Stats::enabled && Step::cont->depth > Stats::max_cont_depth)
+            Stats::max_cont_depth = Step::cont->depth;
+        if(Step::mode == Step::interp_mode){
+            if(Step::steps >= meter.limit)
+                meter.out_of_fuel();
+            Step::steps++;
+            if(Stats::enabled)
+                Stats::step_interps[Step::expr->kind]++;
+            TRACE_STEP(Step::expr->kind, Trace::interp_phase, Step::expr->span_start, Step::expr->span_end, Step::cont->depth);
             Step::expr->step_interp();
+        }
         else{
             if(Step::cont == Cont::done)
                 return Step::val;
-            else
-                Step::cont->step_continue();
+            if(token != NULL && token->cancelled())
+                throw EvalCancelled();
+            if(Step::steps >= meter.limit)
+                meter.out_of_fuel();
+            Step::steps++;
+            if(Stats::enabled)
+                Stats::step_continues[Step::cont->kind]++;
+            TRACE_STEP(Step::cont->kind, Trace::continue_phase, -1, -1, Step::cont->depth);
+            Step::cont->step_continue();
         }
     }
 }
@@ -16,6 +16,8 @@
 #include "pointer.h"
 #include "Env.h"
 #include "Cont.h"
+#include "Cancel.h"
+#include "Fuel.h"
 
 class Expr;
 class Env;
@@ -35,8 +37,20 @@ public:
     static PTR(Env) env;
     static PTR(Val) val;
     static PTR(Cont) cont;
-    static PTR(Val) interp_by_steps(PTR(Expr) e);
     
+    //number of step_interp and step_continue calls made by the last interp_by_steps
+    static long steps;
+    
+    //stops with EvalCancelled once cancel, or the token of the current
+    //CancelScope, is cancelled, and with OutOfFuel when the Fuel of the
+    //current FuelScope runs out
+    static PTR(Val) interp_by_steps(PTR(Expr) e, PTR(Env) env = Env::empty, CancelToken *cancel = NULL);
+    //carries on from where stopped ran out of fuel, burning the Fuel of
+    //the current FuelScope
+    static PTR(Val) resume(const OutOfFuel &stopped, CancelToken *cancel = NULL);
+    
+private:
+    static PTR(Val) run(CancelToken *cancel);
 };
 
 #endif /* Step_hpp */
@@ -0,0 +1,192 @@
+//
+//  Trace.cpp
+//  msdscript
+//
+
+#include "Trace.h"
+#include "catch.h"
+#include "Stats.h"
+#include "Step.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+bool Trace::enabled = false;
+TraceEvent *Trace::ring = NULL;
+uint64_t Trace::next = 0;
+uint64_t Trace::last_ticks = 0;
+
+//start of a dump file, followed by `count` events, oldest first
+struct TraceHeader {
+    char magic[8];
+    uint64_t count;
+    uint64_t first_ticks;
+    double ns_per_tick;
+};
+
+static const char MAGIC[8] = {'M', 'S', 'D', 'T', 'R', 'C', '1', '\0'};
+
+//a copy of the path for the SIGUSR1 handler, which can't touch std::string
+static char dump_path[1024];
+static uint64_t start_ticks;
+static uint64_t start_ns;
+
+static uint64_t monotonic_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void on_sigusr1(int){
+    Trace::dump(dump_path);
+}
+
+void Trace::start(std::string path){
+#ifndef MSD_TRACE
+    throw std::runtime_error("--trace needs a build with -DMSD_TRACE");
+#endif
+    if(path.length() >= sizeof(dump_path))
+        throw std::runtime_error("trace path too long");
+    strcpy(dump_path, path.c_str());
+    if(ring == NULL)
+        ring = new TraceEvent[CAPACITY];
+    next = 0;
+    start_ticks = ticks();
+    start_ns = monotonic_ns();
+    signal(SIGUSR1, on_sigusr1);
+    enabled = true;
+}
+
+void Trace::stop(){
+    enabled = false;
+    signal(SIGUSR1, SIG_DFL);
+}
+
+static bool write_all(int fd, const void *data, size_t length){
+    const char *p = (const char *)data;
+    while(length > 0){
+        ssize_t n = write(fd, p, length);
+        if(n <= 0)
+            return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+void Trace::dump(const char *path){
+    uint64_t end = next;
+    uint64_t count = (end < CAPACITY) ? end : CAPACITY;
+    uint64_t first = end - count;
+    
+    TraceHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.count = count;
+    header.first_ticks = start_ticks;
+    uint64_t elapsed_ticks = ticks() - start_ticks;
+    uint64_t elapsed_ns = monotonic_ns() - start_ns;
+    header.ns_per_tick = elapsed_ticks ? (double)elapsed_ns / elapsed_ticks : 1;
+    
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return;
+    bool ok = write_all(fd, &header, sizeof(header));
+    //oldest events sit after the newest once the ring has wrapped
+    uint64_t at = first & (CAPACITY - 1);
+    uint64_t tail = (at + count > CAPACITY) ? CAPACITY - at : count;
+    if(ok)
+        ok = write_all(fd, ring + at, tail * sizeof(TraceEvent));
+    if(ok && tail < count)
+        write_all(fd, ring, (count - tail) * sizeof(TraceEvent));
+    close(fd);
+}
+
+void Trace::decode(std::string path, std::ostream &out){
+    std::ifstream in(path, std::ios::binary);
+    TraceHeader header;
+    if(!in.read((char *)&header, sizeof(header)) || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+        throw std::runtime_error("not a trace file: " + path);
+    std::vector<TraceEvent> events(header.count);
+    if(header.count > 0 && !in.read((char *)&events[0], header.count * sizeof(TraceEvent)))
+        throw std::runtime_error("truncated trace file: " + path);
+    
+    //events that share a clock reading are spread evenly up to the next
+    //reading; each step lasts until the next one starts, and the last gets
+    //no duration
+    std::vector<double> times(events.size());
+    size_t run = 0;
+    for(size_t i = 0; i <= events.size(); i++){
+        if(i < events.size() && events[i].ticks == events[run].ticks)
+            continue;
+        double start = (events[run].ticks - header.first_ticks) * header.ns_per_tick / 1000;
+        double end = (i < events.size()) ? (events[i].ticks - header.first_ticks) * header.ns_per_tick / 1000 : start;
+        for(size_t j = run; j < i; j++)
+            times[j] = start + (end - start) * (j - run) / (i - run);
+        run = i;
+    }
+    out << "{\"traceEvents\": [\n" << std::fixed << std::setprecision(3);
+    for(size_t i = 0; i < events.size(); i++){
+        const TraceEvent &e = events[i];
+        double ts = times[i];
+        double dur = (i + 1 < events.size()) ? times[i + 1] - ts : 0;
+        const char *name = (e.phase == interp_phase) ? Stats::expr_name(e.kind) : Stats::cont_name(e.kind);
+        out << "{\"name\": \"" << name << "\", \"cat\": \""
+            << (e.phase == interp_phase ? "step_interp" : "step_continue")
+            << "\", \"ph\": \"X\", \"ts\": " << ts << ", \"dur\": " << dur
+            << ", \"pid\": 1, \"tid\": 1, \"args\": {\"span\": [" << e.span_start << ", " << e.span_end
+            << "], \"cont_depth\": " << e.cont_depth << "}}"
+            << (i + 1 < events.size() ? "," : "") << "\n";
+    }
+    out << "]}\n";
+}
+
+TEST_CASE("Trace"){
+    //fills the ring by hand so this runs without -DMSD_TRACE too
+    if(Trace::ring == NULL)
+        Trace::ring = new TraceEvent[Trace::CAPACITY];
+    Trace::next = 0;
+    Trace::last_ticks = 0;
+    Trace::record(expr_kind_add, Trace::interp_phase, 0, 5, 0);
+    Trace::record(cont_kind_add, Trace::continue_phase, -1, -1, 1);
+    
+    char path[] = "/tmp/msdtraceXXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    close(fd);
+    Trace::dump(path);
+    std::stringstream out;
+    Trace::decode(path, out);
+    unlink(path);
+    
+    std::string json = out.str();
+    CHECK(json.find("{\"traceEvents\": [\n{\"name\": \"AddExpr\", \"cat\": \"step_interp\", \"ph\": \"X\"") == 0);
+    CHECK(json.find("\"args\": {\"span\": [0, 5], \"cont_depth\": 0}},\n{\"name\": \"AddCont\"") != std::string::npos);
+    CHECK(json.find("\"args\": {\"span\": [-1, -1], \"cont_depth\": 1}}\n]}\n") != std::string::npos);
+    CHECK_THROWS_WITH(Trace::decode("/nonexistent/trace", out), "not a trace file: /nonexistent/trace");
+    
+    //and the step machine records its own steps when built for it
+    char run_path[] = "/tmp/msdtraceXXXXXX";
+    fd = mkstemp(run_path);
+    REQUIRE(fd >= 0);
+    close(fd);
+#ifdef MSD_TRACE
+    Trace::start(run_path);
+    Step::interp_by_steps(parse_str("1 + 2"));
+    Trace::stop();
+    CHECK((long)Trace::next == Step::steps);
+    Trace::dump(run_path);
+    std::stringstream run_out;
+    Trace::decode(run_path, run_out);
+    CHECK(run_out.str().find("{\"name\": \"AddExpr\", \"cat\": \"step_interp\"") != std::string::npos);
+    CHECK(run_out.str().find("{\"name\": \"AddCont\", \"cat\": \"step_continue\"") != std::string::npos);
+#else
+    CHECK_THROWS_WITH(Trace::start(run_path), "--trace needs a build with -DMSD_TRACE");
+#endif
+    unlink(run_path);
+}
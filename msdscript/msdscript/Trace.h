@@ -0,0 +1,92 @@
+//
+//  Trace.h
+//  msdscript
+//
+
+#ifndef Trace_h
+#define Trace_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <ostream>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//one step of the step machine, as stored in the trace ring buffer
+struct TraceEvent {
+    uint64_t ticks;
+    int32_t span_start;
+    int32_t span_end;
+    uint32_t cont_depth;
+    uint8_t kind;       //expr_kind_t for step_interp, cont_kind_t for step_continue
+    uint8_t phase;      //Trace::interp_phase or Trace::continue_phase
+    uint16_t unused;
+};
+
+//binary execution trace for --trace; the step machine records every step into a
+//fixed-size ring buffer, so a dump holds the most recent steps before the end
+//of a run, an error, or a SIGUSR1. Recording is compiled in only with
+//-DMSD_TRACE, as `make msdscript-trace` does; without it TRACE_STEP expands
+//to nothing
+class Trace {
+public:
+    static const uint8_t interp_phase = 0;
+    static const uint8_t continue_phase = 1;
+    static const uint64_t CAPACITY = 1 << 16;
+    //reading the clock costs more than a step, so only every TICK_INTERVAL-th
+    //event reads it and the rest repeat that reading; decode spreads them out
+    static const uint64_t TICK_INTERVAL = 32;
+    
+    static bool enabled;
+    static TraceEvent *ring;
+    //events recorded since start; the newest is at (next - 1) % CAPACITY
+    static uint64_t next;
+    static uint64_t last_ticks;
+    
+    //starts recording; SIGUSR1 then dumps to path without stopping
+    static void start(std::string path);
+    static void stop();
+    //writes the buffer to path using only async-signal-safe calls
+    static void dump(const char *path);
+    //converts a dump into Chrome trace event JSON
+    static void decode(std::string path, std::ostream &out);
+    
+    //cheapest monotonic counter available; dumps carry its rate in nanoseconds
+    static inline uint64_t ticks(){
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t t;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+        return t;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    
+    static inline void record(uint8_t kind, uint8_t phase, int32_t span_start, int32_t span_end, long depth){
+        TraceEvent &e = ring[next & (CAPACITY - 1)];
+        if((next & (TICK_INTERVAL - 1)) == 0)
+            last_ticks = ticks();
+        e.ticks = last_ticks;
+        e.span_start = span_start;
+        e.span_end = span_end;
+        e.cont_depth = (uint32_t)depth;
+        e.kind = kind;
+        e.phase = phase;
+        e.unused = 0;
+        next++;
+    }
+};
+
+#ifdef MSD_TRACE
+#define TRACE_STEP(kind, phase, span_start, span_end, depth) \
+    do { if(Trace::enabled) Trace::record(kind, phase, span_start, span_end, depth); } while(0)
+#else
+#define TRACE_STEP(kind, phase, span_start, span_end, depth) do {} while(0)
+#endif
+
+#endif /* Trace_h */
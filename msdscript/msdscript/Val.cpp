@@ -10,6 +10,13 @@
 #include "catch.h"
 #include "Step.h"
 #include "Cont.h"
+#include "Stats.h"
+#include "Profile.h"
+#include "Memo.h"
+#include "Cancel.h"
+#include "Fuel.h"
+#include "Parse.h"
+#include "Native.h"
 
 std::string Val::to_string(){
     std::ostream stream(nullptr);
@@ -19,30 +26,36 @@ std::string Val::to_string(){
     return str.str();
 }
 
-NumVal::NumVal(int num){
+NumVal::NumVal(int64_t num){
+    this->kind = KIND;
+    if(Stats::enabled)
+        Stats::vals[KIND]++;
     this->val = num;
 }
 
 bool NumVal::equals(PTR(Val) other){
-    PTR(NumVal) num = CAST(NumVal)(other);
+    PTR(NumVal) num = KIND_CAST(NumVal)(other);
     if(num == NULL)
         return false;
     else
         return this->val == num->val;
 }
 
+//a BigVal or a non-number goes the slow way, which also reports the error
 PTR(Val) NumVal::add_to(PTR(Val) rhs){
-    PTR(NumVal) other_num = CAST(NumVal)(rhs);
-    if(other_num == NULL)
-        throw std::runtime_error("add of non-number");
-    return NEW(NumVal)(this->val + other_num->val);
+    PTR(NumVal) other_num = KIND_CAST(NumVal)(rhs);
+    int64_t sum;
+    if(other_num == NULL || __builtin_add_overflow(this->val, other_num->val, &sum))
+        return BigVal::add(THIS, rhs);
+    return NEW(NumVal)(sum);
 }
 
 PTR(Val) NumVal::mult_to(PTR(Val) rhs){
-    PTR(NumVal) other_num = CAST(NumVal)(rhs);
-    if(other_num == NULL)
-        throw std::runtime_error("mult of non-number");
-    return NEW(NumVal)(this->val * other_num->val);
+    PTR(NumVal) other_num = KIND_CAST(NumVal)(rhs);
+    int64_t product;
+    if(other_num == NULL || __builtin_mul_overflow(this->val, other_num->val, &product))
+        return BigVal::mult(THIS, rhs);
+    return NEW(NumVal)(product);
 }
 
 bool NumVal::is_true(){
@@ -61,12 +74,201 @@ void NumVal::print(std::ostream& output){
     output << this->val;
 }
 
+typedef std::vector<uint32_t> Digits;
+
+BigVal::BigVal(bool negative, std::vector<uint32_t> digits){
+    this->kind = KIND;
+    if(Stats::enabled)
+        Stats::vals[KIND]++;
+    this->negative = negative;
+    this->digits = digits;
+    //the digits grow without bound, so they count against the heap too
+    HeapScope::charge(this->digits.capacity() * sizeof(uint32_t));
+}
+
+BigVal::~BigVal(){
+    HeapScope::credit(digits.capacity() * sizeof(uint32_t));
+}
+
+//sign and magnitude of a NumVal or BigVal; false for anything else
+static bool big_parts(PTR(Val) v, bool *negative, Digits *mag){
+    if(PTR(NumVal) n = KIND_CAST(NumVal)(v)){
+        *negative = n->val < 0;
+        //negating in unsigned works for INT64_MIN too
+        uint64_t m = *negative ? 0 - (uint64_t)n->val : (uint64_t)n->val;
+        mag->clear();
+        while(m != 0){
+            mag->push_back((uint32_t)m);
+            m >>= 32;
+        }
+        return true;
+    }
+    if(PTR(BigVal) b = KIND_CAST(BigVal)(v)){
+        *negative = b->negative;
+        *mag = b->digits;
+        return true;
+    }
+    return false;
+}
+
+//the smallest form of a number, a NumVal whenever it fits
+static PTR(Val) big_result(bool negative, Digits mag){
+    while(!mag.empty() && mag.back() == 0)
+        mag.pop_back();
+    if(mag.size() <= 2){
+        uint64_t m = mag.empty() ? 0 : mag[0];
+        if(mag.size() == 2)
+            m |= (uint64_t)mag[1] << 32;
+        if(!negative && m <= (uint64_t)INT64_MAX)
+            return NEW(NumVal)((int64_t)m);
+        if(negative && m <= (uint64_t)INT64_MAX + 1)
+            return NEW(NumVal)((int64_t)(0 - m));
+    }
+    return NEW(BigVal)(negative, mag);
+}
+
+static int compare_mag(const Digits &a, const Digits &b){
+    if(a.size() != b.size())
+        return a.size() < b.size() ? -1 : 1;
+    for(size_t i = a.size(); i-- > 0;)
+        if(a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    return 0;
+}
+
+static Digits add_mag(const Digits &a, const Digits &b){
+    Digits sum;
+    uint64_t carry = 0;
+    for(size_t i = 0; i < a.size() || i < b.size() || carry; i++){
+        carry += (i < a.size() ? a[i] : 0) + (uint64_t)(i < b.size() ? b[i] : 0);
+        sum.push_back((uint32_t)carry);
+        carry >>= 32;
+    }
+    return sum;
+}
+
+//a - b, for a at least b
+static Digits sub_mag(const Digits &a, const Digits &b){
+    Digits diff;
+    int64_t borrow = 0;
+    for(size_t i = 0; i < a.size(); i++){
+        int64_t d = (int64_t)a[i] - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = d < 0;
+        diff.push_back((uint32_t)(d + (borrow << 32)));
+    }
+    return diff;
+}
+
+static Digits mult_mag(const Digits &a, const Digits &b){
+    Digits product(a.size() + b.size(), 0);
+    for(size_t i = 0; i < a.size(); i++){
+        //a product of huge numbers can take seconds, so it can be cancelled
+        //a row at a time
+        CancelScope::check();
+        uint64_t carry = 0;
+        for(size_t j = 0; j < b.size() || carry; j++){
+            carry += product[i + j] + (j < b.size() ? (uint64_t)a[i] * b[j] : 0);
+            product[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+    }
+    return product;
+}
+
+PTR(Val) BigVal::parse(std::string s){
+    bool negative = !s.empty() && s[0] == '-';
+    Digits mag;
+    for(size_t i = negative ? 1 : 0; i < s.size(); i++){
+        uint64_t carry = s[i] - '0';
+        for(size_t j = 0; j < mag.size(); j++){
+            carry += (uint64_t)mag[j] * 10;
+            mag[j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if(carry)
+            mag.push_back((uint32_t)carry);
+    }
+    return big_result(negative, mag);
+}
+
+PTR(Val) BigVal::add(PTR(Val) lhs, PTR(Val) rhs){
+    bool lneg, rneg;
+    Digits l, r;
+    if(!big_parts(lhs, &lneg, &l) || !big_parts(rhs, &rneg, &r))
+        throw std::runtime_error("add of non-number");
+    if(lneg == rneg)
+        return big_result(lneg, add_mag(l, r));
+    if(compare_mag(l, r) >= 0)
+        return big_result(lneg, sub_mag(l, r));
+    return big_result(rneg, sub_mag(r, l));
+}
+
+PTR(Val) BigVal::mult(PTR(Val) lhs, PTR(Val) rhs){
+    bool lneg, rneg;
+    Digits l, r;
+    if(!big_parts(lhs, &lneg, &l) || !big_parts(rhs, &rneg, &r))
+        throw std::runtime_error("mult of non-number");
+    return big_result(lneg != rneg, mult_mag(l, r));
+}
+
+bool BigVal::equals(PTR(Val) other){
+    PTR(BigVal) b = KIND_CAST(BigVal)(other);
+    return b != NULL && b->negative == negative && b->digits == digits;
+}
+
+PTR(Val) BigVal::add_to(PTR(Val) rhs){
+    return add(THIS, rhs);
+}
+
+PTR(Val) BigVal::mult_to(PTR(Val) rhs){
+    return mult(THIS, rhs);
+}
+
+//peels off nine decimal digits at a time, least significant first
+void BigVal::print(std::ostream& output){
+    Digits mag = digits;
+    std::vector<uint32_t> chunks;
+    while(!mag.empty()){
+        uint64_t rem = 0;
+        for(size_t i = mag.size(); i-- > 0;){
+            uint64_t cur = (rem << 32) | mag[i];
+            mag[i] = (uint32_t)(cur / 1000000000);
+            rem = cur % 1000000000;
+        }
+        chunks.push_back((uint32_t)rem);
+        while(!mag.empty() && mag.back() == 0)
+            mag.pop_back();
+    }
+    std::string s = negative ? "-" : "";
+    s += std::to_string(chunks.back());
+    for(size_t i = chunks.size() - 1; i-- > 0;){
+        std::string chunk = std::to_string(chunks[i]);
+        s += std::string(9 - chunk.size(), '0') + chunk;
+    }
+    output << s;
+}
+
+bool BigVal::is_true(){
+    throw std::runtime_error("Test expression is not a boolean");
+}
+
+PTR(Val) BigVal::call(PTR(Val) actual_arg){
+    throw std::runtime_error("calling not allowed on numval");
+}
+
+void BigVal::call_step(PTR(Val) actual_arg, PTR(Cont) rest) {
+    throw std::runtime_error("attempted to use call_step on a NumVal");
+}
+
 BoolVal::BoolVal(bool boolVal){
+    this->kind = KIND;
+    if(Stats::enabled)
+        Stats::vals[KIND]++;
     this->boolVal = boolVal;
 }
 
 bool BoolVal::equals(PTR(Val) other){
-    PTR(BoolVal) b = CAST(BoolVal)(other);
+    PTR(BoolVal) b = KIND_CAST(BoolVal)(other);
     if(b == NULL)
         return false;
     else
@@ -101,13 +303,18 @@ void BoolVal::call_step(PTR(Val) actual_arg, PTR(Cont) rest) {
 }
 
 FunVal::FunVal(std::string formal_arg, PTR(Expr) body, PTR(Env) env){
+    this->kind = KIND;
+    if(Stats::enabled)
+        Stats::vals[KIND]++;
     this->formal_arg = formal_arg;
     this->body = body;
     this->env = env;
 }
 
 bool FunVal::equals(PTR(Val) other){
-    PTR(FunVal) f = CAST(FunVal)(other);
+    if(other != NULL && &*other == this)
+        return true;
+    PTR(FunVal) f = KIND_CAST(FunVal)(other);
     if(f == NULL)
         return false;
     else
@@ -135,16 +342,199 @@ bool FunVal::is_true(){
 }
 
 PTR(Val) FunVal::call(PTR(Val) actual_arg){
-    return body->interp(NEW(ExtendedEnv)(formal_arg, actual_arg, env));
+    CancelScope::check();
+    FuelScope::burn();
+    if(Memo::enabled){
+        PTR(Val) memoized = Memo::find(THIS, &actual_arg, 1);
+        if(memoized != NULL)
+            return memoized;
+    }
+    ProfileCall frame(&*body);
+    PTR(Val) result = body->interp(NEW(ExtendedEnv)(formal_arg, actual_arg, env));
+    if(Memo::enabled)
+        Memo::store(THIS, &actual_arg, 1, result);
+    return result;
+}
+
+//a memoized result is the call's value straight away; otherwise the body's
+//value passes through a MemoStoreCont on its way to rest
+static bool memo_step(PTR(Val) fun, PTR(Val) *args, int count, PTR(Cont) &rest){
+    PTR(Val) memoized = Memo::find(fun, args, count);
+    if(memoized != NULL){
+        Step::mode = Step::continue_mode;
+        Step::val = memoized;
+        Step::cont = rest;
+        return true;
+    }
+    rest = NEW(MemoStoreCont)(fun, args, count, rest);
+    return false;
 }
 
 void FunVal::call_step(PTR(Val) actual_arg_val, PTR(Cont) rest) {
+    if(Memo::enabled && memo_step(THIS, &actual_arg_val, 1, rest))
+        return;
     Step::mode = Step::interp_mode;
     Step::expr = body;
     Step::env = NEW(ExtendedEnv)(formal_arg, actual_arg_val, env);
     Step::cont = rest;
 }
 
+int FunVal::arity(){
+    PTR(FunExpr) inner = KIND_CAST(FunExpr)(body);
+    return (inner == NULL) ? 1 : inner->arity + 1;
+}
+
+PTR(FrameEnv) FunVal::frame(int count){
+    const std::string *names[FrameEnv::MAX_SLOTS];
+    names[0] = &formal_arg;
+    PTR(Expr) inner = body;
+    for(int i = 1; i < count; i++){
+        PTR(FunExpr) f = KIND_CAST(FunExpr)(inner);
+        names[i] = &f->formal_arg;
+        inner = f->body;
+    }
+    PTR(FrameEnv) frame = NEW(FrameEnv)(count, THIS, inner, env);
+    for(int i = 0; i < count; i++)
+        frame->names[i] = names[i];
+    return frame;
+}
+
+PTR(Val) FunVal::call_frame(PTR(FrameEnv) frame){
+    CancelScope::check();
+    FuelScope::burn();
+    if(Memo::enabled){
+        PTR(Val) memoized = Memo::find(THIS, frame->vals, frame->count);
+        if(memoized != NULL)
+            return memoized;
+    }
+    ProfileCall profiled(&*frame->body);
+    PTR(Val) result = frame->body->interp(frame);
+    if(Memo::enabled)
+        Memo::store(THIS, frame->vals, frame->count, result);
+    return result;
+}
+
+void FunVal::call_frame_step(PTR(FrameEnv) frame, PTR(Cont) rest){
+    if(Memo::enabled && memo_step(THIS, frame->vals, frame->count, rest))
+        return;
+    Step::mode = Step::interp_mode;
+    Step::expr = frame->body;
+    Step::env = frame;
+    Step::cont = rest;
+}
+
+NativeFunVal::NativeFunVal(std::string name, int arity, native_fn_t fn){
+    if(arity < 1 || arity > MAX_ARITY)
+        throw std::runtime_error("native " + name + " must take 1 to " + std::to_string(MAX_ARITY) + " arguments");
+    this->kind = KIND;
+    if(Stats::enabled)
+        Stats::vals[KIND]++;
+    this->name = name;
+    this->arity = arity;
+    this->sig = native_sig_vals;
+    this->fn = fn;
+    this->num1 = NULL;
+    this->num2 = NULL;
+    this->bound_count = 0;
+}
+
+NativeFunVal::NativeFunVal(std::string name, native_num1_t num1){
+    this->kind = KIND;
+    if(Stats::enabled)
+        Stats::vals[KIND]++;
+    this->name = name;
+    this->arity = 1;
+    this->sig = native_sig_num1;
+    this->fn = NULL;
+    this->num1 = num1;
+    this->num2 = NULL;
+    this->bound_count = 0;
+}
+
+NativeFunVal::NativeFunVal(std::string name, native_num2_t num2){
+    this->kind = KIND;
+    if(Stats::enabled)
+        Stats::vals[KIND]++;
+    this->name = name;
+    this->arity = 2;
+    this->sig = native_sig_num2;
+    this->fn = NULL;
+    this->num1 = NULL;
+    this->num2 = num2;
+    this->bound_count = 0;
+}
+
+bool NativeFunVal::equals(PTR(Val) other){
+    if(other != NULL && &*other == this)
+        return true;
+    PTR(NativeFunVal) n = KIND_CAST(NativeFunVal)(other);
+    if(n == NULL || n->sig != sig || n->fn != fn || n->num1 != num1 || n->num2 != num2 || n->bound_count != bound_count)
+        return false;
+    for(int i = 0; i < bound_count; i++){
+        if(!bound[i]->equals(n->bound[i]))
+            return false;
+    }
+    return true;
+}
+
+PTR(Val) NativeFunVal::add_to(PTR(Val) rhs){
+    throw std::runtime_error("addition of non-number");
+}
+
+PTR(Val) NativeFunVal::mult_to(PTR(Val) rhs){
+    throw std::runtime_error("multiplication of non-number");
+}
+
+void NativeFunVal::print(std::ostream& output){
+    output << "<native " << name << ">";
+}
+
+bool NativeFunVal::is_true(){
+    throw std::runtime_error("Test expression is not a boolean");
+}
+
+PTR(Val) NativeFunVal::call(PTR(Val) actual_arg){
+    if(bound_count + 1 == arity){
+        PTR(Val) args[MAX_ARITY];
+        for(int i = 0; i < bound_count; i++)
+            args[i] = bound[i];
+        args[bound_count] = actual_arg;
+        return call_native(args);
+    }
+    PTR(NativeFunVal) partial = NEW(NativeFunVal)(*this);
+    if(Stats::enabled)
+        Stats::vals[KIND]++;
+    partial->bound[bound_count] = actual_arg;
+    partial->bound_count++;
+    return partial;
+}
+
+void NativeFunVal::call_step(PTR(Val) actual_arg_val, PTR(Cont) rest){
+    Step::mode = Step::continue_mode;
+    Step::val = call(actual_arg_val);
+    Step::cont = rest;
+}
+
+int64_t NativeFunVal::num_arg(std::string name, PTR(Val) v){
+    PTR(NumVal) n = KIND_CAST(NumVal)(v);
+    if(n == NULL && KIND_CAST(BigVal)(v) == NULL)
+        throw std::runtime_error(name + " of non-number");
+    if(n == NULL)
+        throw std::runtime_error(name + " of a number too large for 64 bits");
+    return n->val;
+}
+
+PTR(Val) NativeFunVal::call_native(PTR(Val) *args){
+    switch(sig){
+        case native_sig_num1:
+            return NEW(NumVal)(num1(num_arg(name, args[0])));
+        case native_sig_num2:
+            return NEW(NumVal)(num2(num_arg(name, args[0]), num_arg(name, args[1])));
+        default:
+            return fn(args);
+    }
+}
+
 TEST_CASE("ValClass"){
     std::string testString = "";
     CHECK((NEW(NumVal)(5))->equals(NEW(NumVal)(5))==true);
@@ -182,3 +572,51 @@ TEST_CASE("ValClass"){
     CHECK((NEW(FunVal)("x", NEW(NumExpr)(5),Env::empty))->call(NEW(NumVal)(3))->equals(NEW(NumVal)(5))==true);
     CHECK((NEW(FunVal)("x", NEW(NumExpr)(5),Env::empty))->call(NEW(NumVal)(3))->equals(NEW(NumVal)(3))==false);
 }
+
+//the value of program, by both engines, which must agree
+static std::string big_run(std::string program){
+    PTR(Expr) e = parse_str(program);
+    std::string interp = e->interp(Natives::env())->to_string();
+    std::string steps = Step::interp_by_steps(e, Natives::env())->to_string();
+    return interp == steps ? interp : interp + " but by steps " + steps;
+}
+
+TEST_CASE("BigVal"){
+    PTR(Val) max = NEW(NumVal)(INT64_MAX);
+    PTR(Val) past = max->add_to(NEW(NumVal)(1));
+    CHECK(past->kind == val_kind_big);
+    CHECK(past->to_string() == "9223372036854775808");
+    CHECK(past->add_to(NEW(NumVal)(-1))->kind == val_kind_num);
+    CHECK(past->add_to(NEW(NumVal)(-1))->equals(max));
+    CHECK(past->equals(BigVal::parse("9223372036854775808")));
+    CHECK(!past->equals(max));
+    CHECK(BigVal::parse("-9223372036854775808")->equals(NEW(NumVal)(INT64_MIN)));
+    CHECK((NEW(NumVal)(INT64_MIN))->mult_to(NEW(NumVal)(-1))->to_string() == "9223372036854775808");
+    CHECK_THROWS_WITH(past->add_to(NEW(BoolVal)(true)), "add of non-number");
+    CHECK_THROWS_WITH(past->mult_to(NULL), "mult of non-number");
+    CHECK_THROWS_WITH(past->is_true(), "Test expression is not a boolean");
+    
+    CHECK(big_run("4294967296 * 4294967296") == "18446744073709551616");
+    CHECK(big_run("-4294967296 * 4294967296 * 4294967296") == "-79228162514264337593543950336");
+    CHECK(big_run("1000000000000000000000000000001 + -1") == "1000000000000000000000000000000");
+    CHECK(big_run("1000000000000000000000 + -1000000000000000000000") == "0");
+    CHECK(big_run("-1000000000000000000000 + 999999999999999999999") == "-1");
+    CHECK(big_run("_letrec fact = _fun (n) _if n == 0 _then 1 _else n * fact(n + -1) _in fact(30)")
+          == "265252859812191058636308480000000");
+    CHECK(big_run("_let a = 9223372036854775807 + 1 _in a == 9223372036854775808") == "_true");
+    CHECK(big_run("pow(2)(100)") == "1267650600228229401496703205376");
+    CHECK(big_run("pow(-3)(41)") == "-36472996377170786403");
+    CHECK(big_run("max(3000000000)(0)") == "3000000000");
+    CHECK(big_run("abs(-3000000000) + min(-3000000000)(1)") == "0");
+    CHECK(big_run("div(9000000000)(-3) + mod(9000000001)(3)") == "-2999999999");
+    //the results that don't fit in 64 bits come back as BigVals
+    CHECK(big_run("abs(-9223372036854775807 + -1)") == "9223372036854775808");
+    CHECK(big_run("div(-9223372036854775807 + -1)(-1)") == "9223372036854775808");
+    CHECK(big_run("mod(-9223372036854775807 + -1)(-1)") == "0");
+    CHECK_THROWS_WITH(big_run("min(10000000000000000000)(1)"), "min of a number too large for 64 bits");
+    
+    //literals don't wrap, and print as they were written
+    CHECK(parse_str("12345678901234567890123")->to_string() == "12345678901234567890123");
+    CHECK(parse_str("-9223372036854775809")->equals(parse_str("-9223372036854775809")));
+    CHECK(!parse_str("9223372036854775808")->equals(parse_str("9223372036854775809")));
+}
@@ -10,6 +10,8 @@
 
 #include <stdio.h>
 #include <iostream>
+#include <vector>
+#include <stdint.h>
 #include "pointer.h"
 #include "Env.h"
 
@@ -17,8 +19,20 @@ class Expr;
 class Cont;
 class Step;
 
+typedef enum {
+    val_kind_num,
+    val_kind_bool,
+    val_kind_fun,
+    val_kind_native,
+    val_kind_compiled_fun,
+    val_kind_big
+} val_kind_t;
+
 CLASS(Val) {
 public:
+    //which subclass this is, add_to/mult_to/equals check it instead of dynamic_cast
+    val_kind_t kind;
+    
     virtual ~Val() {};
 //    virtual PTR(Expr) to_expr() = 0;
     virtual bool equals(PTR(Val) v) = 0;
@@ -31,11 +45,13 @@ public:
     std::string to_string();
 };
 
+//+ and * check for overflow and give a BigVal when the result doesn't fit
 class NumVal : public Val {
 public:
-    int val;
+    int64_t val;
+    static const val_kind_t KIND = val_kind_num;
     
-    NumVal(int val);
+    NumVal(int64_t val);
     
 //    PTR(Expr) to_expr();
     bool equals(PTR(Val) v);
@@ -48,9 +64,37 @@ public:
     
 };
 
+//a number too large for a NumVal. Results are always put in the smallest
+//form, so a number fits in a NumVal exactly when it isn't a BigVal
+class BigVal : public Val {
+public:
+    bool negative;
+    //magnitude, least significant 32 bits first
+    std::vector<uint32_t> digits;
+    static const val_kind_t KIND = val_kind_big;
+    
+    BigVal(bool negative, std::vector<uint32_t> digits);
+    ~BigVal();
+    
+    //a NumVal or BigVal for an optional '-' and then decimal digits
+    static PTR(Val) parse(std::string s);
+    //sum and product of two NumVals or BigVals
+    static PTR(Val) add(PTR(Val) lhs, PTR(Val) rhs);
+    static PTR(Val) mult(PTR(Val) lhs, PTR(Val) rhs);
+    
+    bool equals(PTR(Val) v);
+    PTR(Val) add_to(PTR(Val) rhs);
+    PTR(Val) mult_to(PTR(Val) rhs);
+    void print(std::ostream& output);
+    bool is_true();
+    PTR(Val) call(PTR(Val) actual_arg);
+    void call_step(PTR(Val) actual_arg_val, PTR(Cont) rest);
+};
+
 class BoolVal : public Val {
 public:
     bool boolVal;
+    static const val_kind_t KIND = val_kind_bool;
     
     BoolVal(bool boolVal);
     
@@ -70,6 +114,7 @@ public:
     std::string formal_arg;
     PTR(Expr)body;
     PTR(Env) env;
+    static const val_kind_t KIND = val_kind_fun;
     
     FunVal(std::string formal_arg, PTR(Expr) body, PTR(Env) env);
     
@@ -81,6 +126,62 @@ public:
     bool is_true();
     PTR(Val) call(PTR(Val) actual_arg);
     void call_step(PTR(Val) actual_arg_val, PTR(Cont) rest);
+    
+    //how many arguments it takes before its body is something other
+    //than another _fun
+    int arity();
+    //a frame for the first count of those arguments, to be filled in
+    //and passed to call_frame or call_frame_step
+    PTR(FrameEnv) frame(int count);
+    PTR(Val) call_frame(PTR(FrameEnv) frame);
+    void call_frame_step(PTR(FrameEnv) frame, PTR(Cont) rest);
+};
+
+//C++ implementations of natives; a native_fn_t gets its arguments as Vals,
+//the others take and give plain 64-bit numbers so no NumVal is looked
+//through by hand
+typedef PTR(Val) (*native_fn_t)(PTR(Val) *args);
+typedef int64_t (*native_num1_t)(int64_t a);
+typedef int64_t (*native_num2_t)(int64_t a, int64_t b);
+
+typedef enum {
+    native_sig_vals,
+    native_sig_num1,
+    native_sig_num2
+} native_sig_t;
+
+//a function written in C++, called one argument at a time like a _fun; until
+//it has arity arguments, each call gives a copy holding one more of them
+class NativeFunVal : public Val {
+public:
+    static const int MAX_ARITY = 4;
+    std::string name;
+    int arity;
+    native_sig_t sig;
+    native_fn_t fn;
+    native_num1_t num1;
+    native_num2_t num2;
+    PTR(Val) bound[MAX_ARITY];
+    int bound_count;
+    static const val_kind_t KIND = val_kind_native;
+    
+    NativeFunVal(std::string name, int arity, native_fn_t fn);
+    NativeFunVal(std::string name, native_num1_t num1);
+    NativeFunVal(std::string name, native_num2_t num2);
+    
+    bool equals(PTR(Val) v);
+    PTR(Val) add_to(PTR(Val) rhs);
+    PTR(Val) mult_to(PTR(Val) rhs);
+    void print(std::ostream& output);
+    bool is_true();
+    PTR(Val) call(PTR(Val) actual_arg);
+    void call_step(PTR(Val) actual_arg_val, PTR(Cont) rest);
+    
+    //runs the function on a full set of arity arguments
+    PTR(Val) call_native(PTR(Val) *args);
+    //the number inside v for the native called name, which has to be a
+    //NumVal
+    static int64_t num_arg(std::string name, PTR(Val) v);
 };
 
 #endif /* Val_hpp */
@@ -8,15 +8,175 @@
 #define CATCH_CONFIG_RUNNER
 #include "cmdline.h"
 #include <iostream>
+#include <fstream>
+#include <iterator>
+
+//all of in, read a buffer at a time
+static std::string read_all(std::istream &in){
+    std::ostringstream all;
+    all << in.rdbuf();
+    return all.str();
+}
+
+//the Heap an evaluation gets; --stats wants its peak even with no limit
+static Heap *eval_heap(Heap &heap, long heap_limit){
+    return heap_limit >= 0 || Stats::enabled ? &heap : NULL;
+}
+
+static void report_heap(Heap &heap, long heap_limit){
+    if(eval_heap(heap, heap_limit) != NULL)
+        std::cerr << "peak heap " << heap.peak << " bytes\n";
+}
+
+void run_mode(std::string mode, std::istream &in, std::ostream &out, PerfCounters *perf, ResultCache *cache, long fuel_limit, long heap_limit){
+    if(mode != "--interp" && mode != "--step" && mode != "--print" && mode != "--pretty-print")
+        throw std::runtime_error("unknown mode " + mode);
+    
+    //only values are cached; the text is needed whole to look them up. A
+    //run under a fuel or heap limit has to run to find out whether the limit
+    //stops it
+    bool cached = cache != NULL && (mode == "--interp" || mode == "--step") && fuel_limit < 0 && heap_limit < 0;
+    std::string source;
+    std::string result;
+    std::istringstream buffered;
+    std::istream *program = &in;
+    if(cached){
+        source = read_all(in);
+        if(cache->find_raw(mode, source, result)){
+            out << result << "\n";
+            return;
+        }
+        buffered.str(source);
+        program = &buffered;
+    }
+    
+    if(perf)
+        perf->begin("parse");
+    //literals make their Vals as they parse, and --stats counts evaluation only
+    bool counting = Stats::enabled;
+    Stats::enabled = false;
+    PTR(Expr)e;
+    try{
+        e = parse_expr(*program);
+    }catch(std::runtime_error &){
+        Stats::enabled = counting;
+        throw;
+    }
+    Stats::enabled = counting;
+    if(perf)
+        perf->end();
+    
+    if(cached && cache->find_normalized(mode, e, result)){
+        cache->store_raw(mode, source, result);
+        out << result << "\n";
+        return;
+    }
+    
+    PTR(Val)val = nullptr;
+    if(mode == "--interp" || mode == "--step"){
+        if(perf)
+            perf->begin("evaluate");
+        Heap heap(heap_limit);
+        {
+            Fuel fuel(fuel_limit);
+            FuelScope fuel_scope(fuel_limit >= 0 ? &fuel : NULL);
+            HeapScope heap_scope(eval_heap(heap, heap_limit));
+            if(mode == "--interp")
+                val = e->interp(Natives::env());
+            else
+                val = Step::interp_by_steps(e, Natives::env());
+        }
+        report_heap(heap, heap_limit);
+        if(perf)
+            perf->end();
+    }
+    
+    if(perf)
+        perf->begin("print");
+    if(cached){
+        result = val->to_string();
+        out << result;
+    }else if(mode == "--interp")
+        val->print(out);
+    else if(mode == "--step")
+        out << val->to_string();
+    else if(mode == "--print")
+        e->print(out);
+    else
+        e->pretty_print(out);
+    out << "\n";
+    if(perf)
+        perf->end();
+    
+    if(cached){
+        cache->store_normalized(mode, e, result);
+        cache->store_raw(mode, source, result);
+    }
+}
+
+void serve_stdio(std::istream &in, std::ostream &out, long fuel_limit, long heap_limit){
+    std::string mode;
+    long length;
+    while(in >> mode >> length){
+        if(in.get() != '\n' || length < 0)
+            throw std::runtime_error("bad request header");
+        std::string program(length, '\0');
+        if(!in.read(&program[0], length))
+            throw std::runtime_error("truncated request");
+        
+        std::istringstream program_in(program);
+        std::ostringstream result;
+        int status = 0;
+        try{
+            run_mode("--" + mode, program_in, result, NULL, NULL, fuel_limit, heap_limit);
+        }catch(std::runtime_error &e){
+            status = 1;
+            result.str(e.what());
+        }
+        std::string body = result.str();
+        out << status << " " << body.length() << "\n" << body;
+        out.flush();
+    }
+}
 
 void use_arguments(int argc,char * argv[]){
     if(argc == 1)
         exit(1);
     bool testSeen = false;
+    std::string profile_path = "";
+    std::string trace_path = "";
+    std::string cache_dir = "";
+    std::string ast_cache_dir = "";
+    long cache_size = 64L << 20;
+    long fuel_limit = -1;
+    long heap_limit = -1;
+    PerfCounters *perf = NULL;
+    for(int i = 1; i < argc; i++){
+        if(std::string(argv[i]) == "--stats")
+            Stats::enabled = true;
+        else if(std::string(argv[i]) == "--memo")
+            Memo::enabled = true;
+        else if(std::string(argv[i]) == "--profile" && i + 1 < argc)
+            profile_path = argv[i + 1];
+        else if(std::string(argv[i]) == "--trace" && i + 1 < argc)
+            trace_path = argv[i + 1];
+        else if(std::string(argv[i]) == "--cache" && i + 1 < argc)
+            cache_dir = argv[i + 1];
+        else if(std::string(argv[i]) == "--cache-size" && i + 1 < argc)
+            cache_size = atol(argv[i + 1]);
+        else if(std::string(argv[i]) == "--ast-cache" && i + 1 < argc)
+            ast_cache_dir = argv[i + 1];
+        else if(std::string(argv[i]) == "--fuel" && i + 1 < argc)
+            fuel_limit = atol(argv[i + 1]);
+        else if(std::string(argv[i]) == "--max-heap" && i + 1 < argc)
+            heap_limit = atol(argv[i + 1]);
+        else if(std::string(argv[i]) == "--perf-counters" && perf == NULL)
+            perf = new PerfCounters();
+    }
     for(int i = 1; i < argc; i++){
         std::string arg = argv[i];
         if(arg == "--help"){
-            std::cout << "Arguments allowed: --help --test --interp --step --print --pretty_print\n";
+            std::cout << "Arguments allowed: --help --test --interp --step --print --pretty-print --serve-stdio --stats --memo --profile <file> --trace <file> --trace-decode <file> --perf-counters --cache <dir> --cache-size <bytes> --compile-ast <file> --run-ast <file> --ast-cache <dir> --fuel <steps> --max-heap <bytes>\n";
             exit(0);
         }else if(arg == "--test" && testSeen == false){
             int fail = Catch::Session().run(1, argv);
@@ -27,26 +187,173 @@ void use_arguments(int argc,char * argv[]){
         }else if(arg == "--test" && testSeen == true){
             std::cerr << "Tests already passed yo\n";
             exit(1);
-        }else if(arg == "--interp"){
-            PTR(Expr)e = parse_expr(std::cin);
-            PTR(Val)out = e->interp(Env::empty);
-            out->print(std::cout);
+        }else if(arg == "--interp" || arg == "--step" || arg == "--print" || arg == "--pretty-print"){
+            //profiles sample the --interp engine only; anything else would
+            //leave the file unwritten
+            if(profile_path != "" && arg != "--interp")
+                throw std::runtime_error("--profile needs --interp");
+            //a compiled image from --ast-cache stands in for parsing; images only
+            //run the way --interp does, and profiles and traces need the Exprs
+            bool use_image = ast_cache_dir != "" && arg == "--interp" && cache_dir == "" && profile_path == "" && trace_path == "";
+            //when profiling or tracing, read everything first so spans have text to point into
+            std::string source;
+            std::istringstream buffered;
+            std::istream *in = &std::cin;
+            if(profile_path != "" || trace_path != "" || use_image){
+                source = read_all(std::cin);
+                buffered.str(source);
+                in = &buffered;
+            }
+            if(profile_path != "")
+                Profile::start(source, 1000);
+            if(trace_path != "")
+                Trace::start(trace_path);
+            ResultCache *cache = NULL;
+            if(cache_dir != "")
+                cache = new ResultCache(cache_dir, cache_size);
+            MsdbImage *image = use_image ? MsdbImage::cached(ast_cache_dir, source) : NULL;
+            try{
+                if(image != NULL){
+                    Fuel fuel(fuel_limit);
+                    FuelScope fuel_scope(fuel_limit >= 0 ? &fuel : NULL);
+                    Heap heap(heap_limit);
+                    {
+                        HeapScope heap_scope(eval_heap(heap, heap_limit));
+                        image->run()->print(std::cout);
+                    }
+                    std::cout << "\n";
+                    report_heap(heap, heap_limit);
+                }else
+                    run_mode(arg, *in, std::cout, perf, cache, fuel_limit, heap_limit);
+            }catch(std::runtime_error &){
+                if(Trace::enabled)
+                    Trace::dump(trace_path.c_str());
+                throw;
+            }
+            if(Trace::enabled){
+                Trace::stop();
+                Trace::dump(trace_path.c_str());
+            }
+            if(Profile::enabled){
+                Profile::stop();
+                std::ofstream out(profile_path);
+                Profile::write_folded(out);
+            }
+            if(Stats::enabled)
+                Stats::print(std::cerr);
+            if(Memo::enabled)
+                Memo::print(std::cerr);
+            if(perf != NULL){
+                perf->print(std::cerr);
+                perf->phases.clear();
+            }
+        }else if(arg == "--profile" || arg == "--trace" || arg == "--cache" || arg == "--cache-size" || arg == "--ast-cache" || arg == "--fuel" || arg == "--max-heap"){
+            //the file name was picked up above
+            i++;
+        }else if(arg == "--trace-decode" && i + 1 < argc){
+            Trace::decode(argv[++i], std::cout);
+        }else if(arg == "--compile-ast" && i + 1 < argc){
+            std::string path = argv[++i];
+            std::string source = read_all(std::cin);
+            PTR(Expr) e = parse_str(source);
+            std::ofstream out(path, std::ios::binary);
+            MsdbImage::write(e, source, out);
+            if(!out.flush())
+                throw std::runtime_error("cannot write " + path);
+        }else if(arg == "--run-ast" && i + 1 < argc){
+            MsdbImage *image = MsdbImage::load(argv[++i]);
+            Fuel fuel(fuel_limit);
+            FuelScope fuel_scope(fuel_limit >= 0 ? &fuel : NULL);
+            Heap heap(heap_limit);
+            {
+                HeapScope heap_scope(eval_heap(heap, heap_limit));
+                image->run()->print(std::cout);
+            }
             std::cout << "\n";
-        }else if(arg == "--step"){
-            PTR(Expr) e = parse_expr(std::cin);
-            PTR(Val) out = Step::interp_by_steps(e);
-            std::cout << out->to_string();
-            std::cout << "\n";
-        }else if(arg == "--print"){
-            PTR(Expr)e = parse_expr(std::cin);
-            e->print(std::cout);
-            std::cout << "\n";
-        }else if(arg == "--pretty-print"){
-            PTR(Expr)e = parse_expr(std::cin);
-            std::cout << e->pp_to_string() << "\n";
+            report_heap(heap, heap_limit);
+            if(Stats::enabled)
+                Stats::print(std::cerr);
+        }else if(arg == "--stats" || arg == "--memo" || arg == "--perf-counters"){
+            //already turned on above, so it can come before or after the mode
+        }else if(arg == "--serve-stdio"){
+            serve_stdio(std::cin, std::cout, fuel_limit, heap_limit);
         }else{
             std::cerr << "Invalid argument";
             exit(1);
         }
     }
 }
+
+TEST_CASE("Serve Stdio"){
+    std::stringstream in;
+    std::stringstream out;
+    in << "interp 3\n1+2" << "print 7\n_true+1" << "step 5\n1+_tr" << "pretty-print 20\n_let x = 1 _in x + 2" << "interp 5\n1+_tr";
+    in << "bogus 1\n1";
+    serve_stdio(in, out);
+    CHECK(out.str() == "0 2\n3\n"
+                       "0 10\n(_true+1)\n"
+                       "1 16\nconsume mismatch"
+                       "0 22\n_let x = 1\n_in  x + 2\n"
+                       "1 16\nconsume mismatch"
+                       "1 20\nunknown mode --bogus");
+    
+    std::stringstream bad("interp 9\n1+2");
+    CHECK_THROWS_WITH(serve_stdio(bad, out), "truncated request");
+    
+    //every request gets the whole budget, whatever ran before it
+    std::string countdown = "_letrec f = _fun (n) _if n == 0 _then 0 _else f(n + -1) _in f(3)";
+    std::stringstream fueled;
+    std::stringstream fueled_out;
+    for(int i = 0; i < 3; i++)
+        fueled << "interp " << countdown.length() << "\n" << countdown;
+    std::string longer = "_letrec f = _fun (n) _if n == 0 _then 0 _else f(n + -1) _in f(9)";
+    fueled << "interp " << longer.length() << "\n" << longer;
+    serve_stdio(fueled, fueled_out, 4);
+    CHECK(fueled_out.str() == "0 2\n0\n0 2\n0\n0 2\n0\n1 25\nout of fuel after 4 steps");
+    
+    //and its own heap, which the parse is not charged to
+    std::stringstream limited;
+    std::stringstream limited_out;
+    for(int i = 0; i < 20; i++)
+        limited << "interp 3\n1+2";
+    limited << "print 3\n1+2";
+    std::stringstream peaks;
+    std::streambuf *err = std::cerr.rdbuf(peaks.rdbuf());
+    serve_stdio(limited, limited_out, -1, 100);
+    std::cerr.rdbuf(err);
+    std::string expected = "";
+    for(int i = 0; i < 20; i++)
+        expected += "0 2\n3\n";
+    CHECK(limited_out.str() == expected + "0 6\n(1+2)\n");
+    //one peak per evaluation, all the same
+    std::string first;
+    std::getline(peaks, first);
+    CHECK(first.find("peak heap ") == 0);
+    std::string expected_peaks = "";
+    for(int i = 0; i < 20; i++)
+        expected_peaks += first + "\n";
+    CHECK(peaks.str() == expected_peaks);
+}
+
+TEST_CASE("Run Mode Stats"){
+    //a chain of _lets does no arithmetic, so it makes no NumVals
+    std::stringstream in("_let x = 1 _in _let y = 2 _in y");
+    std::stringstream out;
+    //--stats also reports the peak heap, which is not checked here
+    std::stringstream peak;
+    std::streambuf *err = std::cerr.rdbuf(peak.rdbuf());
+    Stats::reset();
+    Stats::enabled = true;
+    run_mode("--interp", in, out);
+    Stats::enabled = false;
+    std::cerr.rdbuf(err);
+    CHECK(out.str() == "2\n");
+    CHECK(Stats::vals[val_kind_num] == 0);
+    CHECK(Stats::envs == 2);
+    
+    std::stringstream bad("_let x = ");
+    Stats::enabled = true;
+    CHECK_THROWS(run_mode("--interp", bad, out));
+    CHECK(Stats::enabled);
+    Stats::enabled = false;
+}
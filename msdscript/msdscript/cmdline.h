@@ -18,9 +18,36 @@
 #include "Env.h"
 #include "Step.h"
 #include "Cont.h"
+#include "Stats.h"
+#include "Profile.h"
+#include "Trace.h"
+#include "PerfCounters.h"
+#include "Native.h"
+#include "Memo.h"
+#include "ResultCache.h"
+#include "Msdb.h"
+#include "Program.h"
+#include "Columns.h"
+#include "Cancel.h"
+#include "Fuel.h"
+#include "Heap.h"
 
 void use_arguments(int argc, char * argv[]);
 
+//runs one of --interp, --step, --print or --pretty-print on the program in `in`,
+//counting the parse, evaluate and print phases separately when perf is given,
+//and looking values up in and adding them to cache when it is given. The
+//evaluation gets a fresh budget of fuel_limit steps and a fresh Heap of
+//heap_limit bytes, unless they are -1
+void run_mode(std::string mode, std::istream &in, std::ostream &out, PerfCounters *perf = NULL, ResultCache *cache = NULL, long fuel_limit = -1, long heap_limit = -1);
+
+//answers framed requests until `in` ends; a request is "<mode> <length>\n"
+//followed by that many bytes of program, where mode is interp, step, print
+//or pretty-print, and each response is "<status> <length>\n" followed by the
+//output (status 0) or the error message (status 1). Each request runs
+//under its own fuel_limit and heap_limit, as run_mode does
+void serve_stdio(std::istream &in, std::ostream &out, long fuel_limit = -1, long heap_limit = -1);
+
 #endif /* cmdline_hpp */
 
 
@@ -9,24 +9,39 @@
 #define pointer_h
 
 #include <memory>
+#include "Heap.h"
 
 #define USE_PLAIN_POINTERS 1
 #if USE_PLAIN_POINTERS
 
-# define NEW(T)    new T
+# define NEW(T)    new (HeapCharged()) T
 # define PTR(T)    T*
 # define CAST(T)   dynamic_cast<T*>
+# define STATIC_CAST(T) static_cast<T*>
 # define CLASS(T)  class T
 # define THIS      this
 
 #else
 
-# define NEW(T)    std::make_shared<T>
+# define NEW(T)    heap_make_shared<T>
 # define PTR(T)    std::shared_ptr<T>
 # define CAST(T)   std::dynamic_pointer_cast<T>
+# define STATIC_CAST(T) std::static_pointer_cast<T>
 # define CLASS(T)  class T : public std::enable_shared_from_this<T>
 # define THIS      shared_from_this()
 
 #endif
 
+// Downcasts through the `kind` tag that Expr, Val and Cont subclasses
+// carry instead of going through RTTI; gives NULL when p is NULL or
+// is some other kind.
+template <class T, class B>
+inline PTR(T) kind_cast(PTR(B) p) {
+    if (p == NULL || p->kind != T::KIND)
+        return NULL;
+    return STATIC_CAST(T)(p);
+}
+
+# define KIND_CAST(T) kind_cast<T>
+
 #endif
@@ -2,10 +2,15 @@
 #include <iostream>
 #include <cassert>
 
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <errno.h>
+#include <sys/wait.h>
 
 #include "exec.hpp"
 
@@ -221,3 +226,128 @@ static void wait_child(pid_t pid, int &exit_code) {
   else
     throw std::runtime_error("unrecognized status from waitpid");
 }
+
+CoProcess::CoProcess(const char *path) {
+  this->path = path;
+  pid = -1;
+  to_child = -1;
+  from_child = -1;
+}
+
+CoProcess::~CoProcess() {
+  if (pid != -1) {
+    ExecResult ignored;
+    stop(ignored);
+  }
+}
+
+// Launch `path --serve-stdio` with pipes on its stdin and stdout; its
+// stderr stays ours
+void CoProcess::start() {
+  signal(SIGPIPE, SIG_IGN);
+
+  int in[2];
+  if (pipe(in) != 0)
+    throw std::runtime_error("stdin pipe failed");
+  int out[2];
+  if (pipe(out) != 0)
+    throw std::runtime_error("stdout pipe failed");
+
+  pid = fork();
+  if (pid == -1)
+    throw std::runtime_error("fork failed");
+  else if (pid == 0) {
+    // child
+    dup2(in[READ_END], STDIN_FD);
+    dup2(out[WRITE_END], STDOUT_FD);
+    close(in[READ_END]);
+    close(in[WRITE_END]);
+    close(out[READ_END]);
+    close(out[WRITE_END]);
+
+    const char *command[] = { path.c_str(), "--serve-stdio", NULL };
+    execv(command[0], (char * const *)command);
+
+    const char *msg = "exec failed\n";
+    write(STDERR_FD, msg, strlen(msg));
+    exit(1);
+  }
+
+  // parent
+  close(in[READ_END]);
+  close(out[WRITE_END]);
+  to_child = in[WRITE_END];
+  from_child = out[READ_END];
+  pending = "";
+}
+
+// Close our ends of the pipes and collect the exit status. A child
+// that stops answering but exits with 0 still counts as a failure.
+void CoProcess::stop(ExecResult &r) {
+  close(to_child);
+  close(from_child);
+  wait_child(pid, r.exit_code);
+  if (r.exit_code == 0)
+    r.exit_code = 1;
+  pid = -1;
+}
+
+// Append whatever the child has written to `pending`; false at EOF
+bool CoProcess::read_more() {
+  char buffer[4096];
+  ssize_t len;
+  do {
+    len = read(from_child, buffer, sizeof(buffer));
+  } while (needs_retry((int)len));
+  if (len <= 0)
+    return false;
+  pending.append(buffer, len);
+  return true;
+}
+
+ExecResult CoProcess::request(std::string mode, std::string program) {
+  ExecResult r;
+  if (pid == -1)
+    start();
+
+  std::string frame = mode + " " + std::to_string(program.length()) + "\n" + program;
+  size_t sent = 0;
+  while (sent < frame.length()) {
+    ssize_t len = write(to_child, frame.c_str() + sent, frame.length() - sent);
+    if (needs_retry((int)len))
+      continue;
+    if (len < 0) {
+      // the child is gone; report how it ended
+      stop(r);
+      return r;
+    }
+    sent += len;
+  }
+
+  size_t newline;
+  while ((newline = pending.find('\n')) == std::string::npos) {
+    if (!read_more()) {
+      stop(r);
+      return r;
+    }
+  }
+  int status = 0;
+  size_t length = 0;
+  if (sscanf(pending.c_str(), "%d %zu", &status, &length) != 2)
+    throw std::runtime_error("bad response header from " + path);
+  pending.erase(0, newline + 1);
+  while (pending.length() < length) {
+    if (!read_more()) {
+      stop(r);
+      return r;
+    }
+  }
+
+  r.exit_code = status;
+  if (status == 0)
+    r.out = pending.substr(0, length);
+  else
+    r.err = pending.substr(0, length);
+  pending.erase(0, length);
+  return r;
+}
@@ -2,6 +2,7 @@
 #define exec_hpp
 
 #include <string>
+#include <sys/types.h>
 
 class ExecResult {
 public:
@@ -17,4 +18,29 @@ public:
 
 extern ExecResult exec_program(int argc, const char * const *argv, std::string input);
 
+// A long-lived `msdscript --serve-stdio` process. Each request sends a
+// mode ("interp", "step", "print" or "pretty-print") and a program over
+// the process's stdin and reads the framed response from its stdout,
+// so comparing implementations doesn't pay for a fork and exec per
+// run. If the process dies, the request reports its exit status or
+// signal like exec_program does, and the next request starts a fresh
+// process.
+class CoProcess {
+public:
+  CoProcess(const char *path);
+  ~CoProcess();
+  ExecResult request(std::string mode, std::string program);
+
+private:
+  std::string path;
+  pid_t pid;
+  int to_child;
+  int from_child;
+  std::string pending;
+
+  void start();
+  void stop(ExecResult &r);
+  bool read_more();
+};
+
 #endif /* exec_hpp */
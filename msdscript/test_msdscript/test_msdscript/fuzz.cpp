@@ -0,0 +1,155 @@
+//
+//  fuzz.cpp
+//  test_msdscript
+//
+//  Differential fuzzer that links the interpreter directly instead of
+//  running the msdscript binary through exec_program. Every generated
+//  program is checked in memory:
+//
+//    - `Expr::interp` and `Step::interp_by_steps` agree on the value,
+//      or both fail
+//    - printing and reparsing gives back an equal expression with the
+//      same value
+//
+//  Cases are split into batches, and each batch runs in a forked
+//  worker so all cores are busy and the memory a batch allocates goes
+//  away with its worker.
+//
+//  Usage: fuzz_msdscript [count] [seed] [jobs]
+//
+//  Case `i` is generated by ExprGenerator from seed + i, so a failure printed as
+//  "case seed N" can be replayed alone with `fuzz_msdscript 1 N 1`.
+//
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../../msdscript/cmdline.h"
+#include "random_expr.hpp"
+
+static const long BATCH_SIZE = 2000;
+static const int MAX_DEPTH = 8;
+
+// Print the outcome of evaluating `e` with the recursive interpreter,
+// or "<error>" if evaluation fails
+static std::string interp_outcome(PTR(Expr) e) {
+    try {
+        return e->interp(Env::empty)->to_string();
+    } catch (std::runtime_error &) {
+        return "<error>";
+    }
+}
+
+// Same as interp_outcome, but through the step machine
+static std::string step_outcome(PTR(Expr) e) {
+    try {
+        return Step::interp_by_steps(e)->to_string();
+    } catch (std::runtime_error &) {
+        return "<error>";
+    }
+}
+
+static void report(unsigned seed, const std::string &in, const std::string &what,
+                   const std::string &a, const std::string &b) {
+    std::cerr << "case seed " << seed << ": " << what << "\n"
+              << "program: " << in << "\n"
+              << "  " << a << "\n"
+              << "  " << b << "\n";
+}
+
+// Check one program; returns false after reporting a mismatch
+static bool check_case(unsigned seed) {
+    GenOptions options;
+    options.depth = MAX_DEPTH;
+    std::string in = ExprGenerator(seed, options).program();
+
+    PTR(Expr) e;
+    try {
+        e = parse_str(in);
+    } catch (std::runtime_error &err) {
+        report(seed, in, "generated program does not parse", err.what(), "");
+        return false;
+    }
+
+    std::string interp_out = interp_outcome(e);
+    std::string step_out = step_outcome(e);
+    if (interp_out != step_out) {
+        report(seed, in, "interp and interp_by_steps disagree", interp_out, step_out);
+        return false;
+    }
+
+    std::string printed = e->to_string();
+    PTR(Expr) reparsed;
+    try {
+        reparsed = parse_str(printed);
+    } catch (std::runtime_error &err) {
+        report(seed, in, "printed program does not parse", printed, err.what());
+        return false;
+    }
+    if (!reparsed->equals(e)) {
+        report(seed, in, "reparsed program is not equal", printed, reparsed->to_string());
+        return false;
+    }
+    std::string reparsed_out = interp_outcome(reparsed);
+    if (reparsed_out != interp_out) {
+        report(seed, in, "reparsed program has a different value", interp_out, reparsed_out);
+        return false;
+    }
+    return true;
+}
+
+// Body of a worker process: check cases [first, first + count)
+static int run_batch(unsigned seed, long first, long count) {
+    for (long i = first; i < first + count; i++) {
+        if (!check_case(seed + (unsigned)i))
+            return 1;
+    }
+    return 0;
+}
+
+int main(int argc, const char * argv[]) {
+    long count = (argc > 1) ? atol(argv[1]) : 100000;
+    unsigned seed = (argc > 2) ? (unsigned)strtoul(argv[2], NULL, 10) : (unsigned)time(NULL);
+    long jobs = (argc > 3) ? atol(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1)
+        jobs = 1;
+
+    std::cout << "fuzzing " << count << " programs from seed " << seed
+              << " on " << jobs << " workers\n";
+
+    time_t start = time(NULL);
+    long next = 0, running = 0, failed = 0;
+    while (next < count || running > 0) {
+        if (next < count && running < jobs && failed == 0) {
+            long batch = (count - next < BATCH_SIZE) ? count - next : BATCH_SIZE;
+            pid_t pid = fork();
+            if (pid == -1)
+                throw std::runtime_error("fork failed");
+            if (pid == 0)
+                _exit(run_batch(seed, next, batch));
+            next += batch;
+            running++;
+            continue;
+        }
+        if (running == 0)
+            break;
+        int status;
+        if (wait(&status) == -1)
+            throw std::runtime_error("wait failed");
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            if (WIFSIGNALED(status))
+                std::cerr << "worker killed by signal " << WTERMSIG(status) << "\n";
+            failed++;
+        }
+    }
+
+    long elapsed = (long)(time(NULL) - start);
+    std::cout << (failed ? "FAILED" : "ok") << " after " << next << " programs in "
+              << elapsed << "s\n";
+    return failed ? 1 : 0;
+}
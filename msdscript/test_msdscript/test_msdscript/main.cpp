@@ -7,24 +7,22 @@
 
 #include <iostream>
 #include "exec.hpp"
+#include "random_expr.hpp"
 #include <time.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 
-static std::string random_expr_string();
-
 int main(int argc, const char * argv[]) {
     srand(clock());
     
     const char * const interp_argv[] = { argv[1], "--interp" };
     const char * const print_argv[] = { argv[1], "--print" };
-    const char * const pprint_argv[] = {argv[1], "--pretty-print"};
     
     if(argc == 2){
         
     for (int i = 0; i < 100; i++) {
-        std::string in = random_expr_string();
+        std::string in = random_expr_string(6);
         std::cout << "Trying " << in << "\n";
         
         ExecResult interp_result = exec_program(2, interp_argv, in);
@@ -36,62 +34,27 @@ int main(int argc, const char * argv[]) {
             throw std::runtime_error("different result for printed");
         }
     }
-    else if(argc == 3) {
-        const char * const interp1_argv[] = { argv[2], "--interp" };
-        const char * const print1_argv[] = { argv[2], "--print" };
-        const char * const pprint1_argv[] = { argv[2], "--pretty-print" };
-        
-        for (int i = 0; i < 100; i++) {
-        std::string in = random_expr_string();
-        std::cout << "Trying " << in << "\n";
-        ExecResult interp_result = exec_program(2, interp_argv, in);
-        ExecResult print_result = exec_program(2, print_argv, in);
-        ExecResult pprint_result = exec_program(2, pprint_argv, in);
+    else if(argc == 3 || argc == 4) {
+        // both builds stay up as --serve-stdio co-processes, so each
+        // comparison costs six requests instead of six fork/execs
+        CoProcess impl(argv[1]);
+        CoProcess impl1(argv[2]);
+        int count = (argc == 4) ? atoi(argv[3]) : 100;
+        const char * const modes[] = { "interp", "print", "pretty-print" };
         
-        ExecResult interp1_result = exec_program(2, interp1_argv, in);
-        ExecResult print1_result = exec_program(2, print1_argv, in);
-        ExecResult pprint1_result = exec_program(2, pprint1_argv, in);
-
-            if (interp_result.out != interp1_result.out){
-                            std::cout << "result 1: " << interp_result.out << "\n";
-                            std::cout << "result 2: " << interp1_result.out << "\n";
-                            throw std::runtime_error("different interp results");
-                        }
-                        if (print_result.out != print1_result.out){
-                            std::cout << "result 1: " << print_result.out << "\n";
-                            std::cout << "result 2: " << print1_result.out << "\n";
-                            throw std::runtime_error("different print results");
-                        }
-                        if (pprint_result.out != pprint1_result.out){
-                            std::cout << "result 1: " << pprint_result.out << "\n";
-                            std::cout << "result 2: " << pprint1_result.out << "\n";
-                            throw std::runtime_error("different pretty print results");
-                        }
+        for (int i = 0; i < count; i++) {
+            std::string in = random_expr_string(6);
+            std::cout << "Trying " << in << "\n";
+            for (const char *mode : modes) {
+                ExecResult result = impl.request(mode, in);
+                ExecResult result1 = impl1.request(mode, in);
+                if (result.exit_code != result1.exit_code || result.out != result1.out){
+                    std::cout << "result 1: " << result.out << result.err << "\n";
+                    std::cout << "result 2: " << result1.out << result1.err << "\n";
+                    throw std::runtime_error(std::string("different ") + mode + " results");
+                }
+            }
         }
     }
     return 0;
 }
-
-std::string random_expr_string() {
-    int n = (rand() % 10);
-    if (n < 5){
-        return std::to_string(rand());
-    }
-    else if (n < 7)
-        if(n == 5)
-            return "(" + random_expr_string() + "+" + random_expr_string() + ")";
-        else
-            return random_expr_string() + "+" + random_expr_string();
-    else if (n < 9)
-        if(n == 7)
-            return "(" + random_expr_string() + "*" + random_expr_string() + ")";
-        else
-            return random_expr_string() + "*" + random_expr_string();
-        else if(n == 8)
-            return "_if 1 == 1 _then " + random_expr_string() + " _else " + random_expr_string();
-    
-    else
-        if(n > 5)
-            return "(_if 1 == 0 _then " + random_expr_string() + " _else " + random_expr_string() + ")";
-        return "_let x = " + random_expr_string() + "_in " + random_expr_string();
-}
@@ -0,0 +1,139 @@
+//
+//  random_expr.cpp
+//  test_msdscript
+//
+//  Created by Nick Beckley on 2/19/21.
+//
+
+#include <stdlib.h>
+#include "random_expr.hpp"
+
+ExprGenerator::ExprGenerator(unsigned seed, GenOptions options) : rng(seed) {
+    this->options = options;
+    this->next_var = 0;
+    this->in_recursion = false;
+}
+
+std::string ExprGenerator::program() {
+    next_var = 0;
+    in_recursion = false;
+    num_vars.clear();
+    fun_vars.clear();
+    return num_expr(options.depth);
+}
+
+// A number in [0, n); rng() % n rather than a distribution class,
+// whose output differs between standard libraries
+int ExprGenerator::pick(int n) {
+    return (int)(rng() % (unsigned)n);
+}
+
+bool ExprGenerator::chance(int percent) {
+    return pick(100) < percent;
+}
+
+// Variables are letters only, so number them in base 26
+std::string ExprGenerator::fresh_var() {
+    int i = next_var++;
+    std::string name = "v";
+    do {
+        name += (char)('a' + i % 26);
+        i /= 26;
+    } while (i > 0);
+    return name;
+}
+
+std::string ExprGenerator::num_expr(int depth) {
+    if (depth <= 0 || pick(4) == 0) {
+        if (!num_vars.empty() && pick(2) == 0)
+            return num_vars[pick((int)num_vars.size())];
+        return std::to_string(pick(201) - 100);
+    }
+    if (!in_recursion && chance(options.recursion_percent))
+        return recursive_expr(depth);
+    if (chance(options.closure_percent)) {
+        if (!fun_vars.empty() && pick(2) == 0)
+            return fun_vars[pick((int)fun_vars.size())] + "(" + num_expr(depth - 1) + ")";
+        return "(" + fun_expr(depth - 1) + ")(" + num_expr(depth - 1) + ")";
+    }
+    switch (pick(4)) {
+        case 0: {
+            int terms = 2 + pick(options.width > 1 ? options.width - 1 : 1);
+            std::string s = "(" + num_expr(depth - 1);
+            for (int i = 1; i < terms; i++)
+                s += " + " + num_expr(depth - 1);
+            return s + ")";
+        }
+        case 1:
+            return "(" + num_expr(depth - 1) + " * " + num_expr(depth - 1) + ")";
+        case 2:
+            return "(_if " + bool_expr(depth - 1) + " _then " + num_expr(depth - 1)
+                + " _else " + num_expr(depth - 1) + ")";
+        default:
+            return let_expr(depth);
+    }
+}
+
+std::string ExprGenerator::bool_expr(int depth) {
+    if (depth <= 0 || pick(3) == 0)
+        return pick(2) ? "_true" : "_false";
+    if (pick(8) == 0)
+        return "(" + bool_expr(depth - 1) + " == " + num_expr(depth - 1) + ")";
+    return "(" + num_expr(depth - 1) + " == " + num_expr(depth - 1) + ")";
+}
+
+// A function from numbers to numbers; its body may use any variable in
+// scope, so it closes over the enclosing _let and _fun bindings
+std::string ExprGenerator::fun_expr(int depth) {
+    if (!fun_vars.empty() && pick(3) == 0)
+        return fun_vars[pick((int)fun_vars.size())];
+    std::string x = fresh_var();
+    num_vars.push_back(x);
+    std::string body = num_expr(depth - 1);
+    num_vars.pop_back();
+    return "_fun (" + x + ") " + body;
+}
+
+std::string ExprGenerator::let_expr(int depth) {
+    std::string x = fresh_var();
+    bool is_fun = chance(options.closure_percent);
+    std::string rhs = is_fun ? fun_expr(depth - 1) : num_expr(depth - 1);
+    std::vector<std::string> &scope = is_fun ? fun_vars : num_vars;
+    scope.push_back(x);
+    std::string body = num_expr(depth - 1);
+    scope.pop_back();
+    return "(_let " + x + " = " + rhs + " _in " + body + ")";
+}
+
+// Recursive countdown, either self-applied, the way recursion is written
+// without _letrec:
+//   _let f = _fun (f) _fun (n) _if n == 0 _then base _else step + f(f)(n + -1)
+//   _in f(f)(count)
+// or with _letrec:
+//   _letrec f = _fun (n) _if n == 0 _then base _else step + f(n + -1)
+//   _in f(count)
+// Recursion does not nest, so the running time stays linear in the size
+// of the program.
+std::string ExprGenerator::recursive_expr(int depth) {
+    std::string f = fresh_var();
+    std::string n = fresh_var();
+    in_recursion = true;
+    num_vars.push_back(n);
+    std::string base = num_expr(depth - 1);
+    std::string step = num_expr(depth - 1);
+    num_vars.pop_back();
+    in_recursion = false;
+    std::string count = std::to_string(pick(options.max_iterations + 1));
+    std::string test = " _if " + n + " == 0 _then " + base + " _else " + step + " + ";
+    if (pick(2) == 0)
+        return "(_letrec " + f + " = _fun (" + n + ")" + test + f + "(" + n + " + -1) _in "
+            + f + "(" + count + "))";
+    return "(_let " + f + " = _fun (" + f + ") _fun (" + n + ")" + test + f + "(" + f + ")(" + n
+        + " + -1) _in " + f + "(" + f + ")(" + count + "))";
+}
+
+std::string random_expr_string(int depth) {
+    GenOptions options;
+    options.depth = depth;
+    return ExprGenerator((unsigned)rand(), options).program();
+}
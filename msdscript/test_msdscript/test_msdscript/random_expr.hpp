@@ -0,0 +1,55 @@
+#ifndef random_expr_hpp
+#define random_expr_hpp
+
+#include <string>
+#include <vector>
+#include <random>
+
+// Shape controls for ExprGenerator
+struct GenOptions {
+    int depth = 6;              // maximum nesting of composite expressions
+    int width = 3;              // maximum number of terms in a `+` chain
+    int closure_percent = 20;   // chance a number comes from a `_fun` or call
+    int recursion_percent = 5;  // chance a number comes from a recursive countdown
+    int max_iterations = 8;     // largest countdown a recursive function runs
+};
+
+// Generates well-scoped msdscript programs over the whole grammar:
+// numbers, booleans, `==`, `+`, `*`, variables, `_let`, `_letrec`,
+// `_if`, `_fun` and calls. Programs are built by type, so every variable is bound
+// where it is used and every program evaluates to a number. `==` now
+// and then compares a boolean with a number, which is allowed and
+// gives _false.
+//
+// The same seed and options always give the same program, on every
+// platform, since only the raw output of std::mt19937 is used.
+class ExprGenerator {
+public:
+    ExprGenerator(unsigned seed, GenOptions options);
+
+    std::string program();
+
+private:
+    std::mt19937 rng;
+    GenOptions options;
+    int next_var;
+    bool in_recursion;
+    std::vector<std::string> num_vars;
+    std::vector<std::string> fun_vars;
+
+    int pick(int n);
+    bool chance(int percent);
+    std::string fresh_var();
+    std::string num_expr(int depth);
+    std::string bool_expr(int depth);
+    std::string fun_expr(int depth);
+    std::string let_expr(int depth);
+    std::string recursive_expr(int depth);
+};
+
+// Build a random msdscript program nested at most `depth` levels with
+// default shape controls. Seeds its generator from rand(), so seed with
+// srand() for a reproducible program.
+extern std::string random_expr_string(int depth);
+
+#endif /* random_expr_hpp */